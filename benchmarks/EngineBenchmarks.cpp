@@ -0,0 +1,476 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <flecs.h>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Body/BodyCreationSettings.h>
+#include <Jolt/Physics/Collision/Shape/BoxShape.h>
+#include <raylib.h>
+#include <raymath.h>
+
+#include "CommonComponents.h"
+#include "InputComponents.h"
+#include "MemoryTracking.h"
+#include "Phases.h"
+#include "PhysicsComponents.h"
+#include "PhysicsSystems.h"
+#include "Profiler.h"
+#include "RenderComponents.h"
+#include "SimulationRunner.h"
+#include "TaskScheduler.h"
+#include "TransformComponents.h"
+#include "TransformSystems.h"
+#include "WorldSnapshot.h"
+
+
+namespace
+{
+    constexpr float kFrameTime = 1.0f / 60.0f;
+    constexpr float kFloorHalfExtent = 200.0f;
+    constexpr int kMaxLoadingFrames = 10000;
+
+    res::TaskScheduler* benchmark_scheduler = nullptr;
+
+    // Headless world with the transform and physics modules, stepped at a fixed 60 Hz
+    class BenchmarkWorld
+    {
+    public:
+        BenchmarkWorld()
+        {
+            benchmark_scheduler->AttachWorld(world_);
+            res::CreatePhases(world_);
+            // Shapes stay in memory, so every run cooks from scratch
+            world_.set<res::ShapeCacheSettingsComponent>({""});
+            world_.import<res::TransformSystems>();
+            world_.import<res::PhysicsSystems>();
+            world_.import<res::PhysicsComponents>();
+            runner_ = std::make_unique<res::SimulationRunner>(
+                world_, std::make_unique<res::FixedTimeSource>(kFrameTime), true);
+        }
+
+        ~BenchmarkWorld()
+        {
+            // Bodies and characters have to go while the physics system is still alive
+            world_.delete_with<res::PhysicsBodyIdComponent>();
+            world_.delete_with<res::CharacterVirtualComponent>();
+        }
+
+        BenchmarkWorld(const BenchmarkWorld&) = delete;
+        BenchmarkWorld& operator=(const BenchmarkWorld&) = delete;
+
+        [[nodiscard]] flecs::world& GetWorld() { return world_; }
+
+        void Step() { runner_->Step(); }
+
+        void AddFloor() const
+        {
+            const auto& handle = world_.get<res::PhysicsHandleComponent>();
+            const JPH::BodyCreationSettings floor_settings{
+                new JPH::BoxShape(JPH::Vec3(kFloorHalfExtent, 0.5f, kFloorHalfExtent)),
+                JPH::RVec3(0.0f, -0.5f, 0.0f), JPH::Quat::sIdentity(), JPH::EMotionType::Static,
+                res::PhysicsObjectLayers::NON_MOVING
+            };
+            handle.body_interface->CreateAndAddBody(floor_settings, JPH::EActivation::DontActivate);
+        }
+
+    private:
+        flecs::world world_;
+        std::unique_ptr<res::SimulationRunner> runner_;
+    };
+
+    // Position on a square grid centered on the origin
+    Vector3 GetGridPosition(const int index, const int count, const float spacing, const float height)
+    {
+        const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+        const float offset = 0.5f * static_cast<float>(side - 1) * spacing;
+        return {static_cast<float>(index % side) * spacing - offset, height,
+                static_cast<float>(index / side) * spacing - offset};
+    }
+
+    // Height field with a shape that depends on seed, so every mesh hashes and cooks separately. Only the CPU
+    // side is filled in, raylib's generators would upload to a GPU
+    struct GeneratedMesh
+    {
+        std::vector<float> vertices;
+        std::vector<unsigned short> indices;
+        Mesh mesh{};
+        Model model{};
+    };
+
+    std::unique_ptr<GeneratedMesh> GenerateHeightFieldMesh(const int resolution, const int seed)
+    {
+        auto generated = std::make_unique<GeneratedMesh>();
+        const float phase = static_cast<float>(seed);
+        for (int z = 0; z <= resolution; ++z)
+        {
+            for (int x = 0; x <= resolution; ++x)
+            {
+                const float height = 0.5f * std::sin(0.7f * static_cast<float>(x) + phase) *
+                                     std::cos(0.3f * static_cast<float>(z) + 0.5f * phase);
+                generated->vertices.insert(generated->vertices.end(),
+                                           {static_cast<float>(x), height, static_cast<float>(z)});
+            }
+        }
+
+        const int row = resolution + 1;
+        for (int z = 0; z < resolution; ++z)
+        {
+            for (int x = 0; x < resolution; ++x)
+            {
+                const auto corner = static_cast<unsigned short>(z * row + x);
+                const auto below = static_cast<unsigned short>(corner + row);
+                generated->indices.insert(generated->indices.end(),
+                                          {corner, below, static_cast<unsigned short>(corner + 1),
+                                           static_cast<unsigned short>(corner + 1), below,
+                                           static_cast<unsigned short>(below + 1)});
+            }
+        }
+
+        generated->mesh.vertexCount = row * row;
+        generated->mesh.triangleCount = 2 * resolution * resolution;
+        generated->mesh.vertices = generated->vertices.data();
+        generated->mesh.indices = generated->indices.data();
+        generated->model.transform = MatrixIdentity();
+        generated->model.meshCount = 1;
+        generated->model.meshes = &generated->mesh;
+        return generated;
+    }
+
+    void SpawnBalls(flecs::world& world, const int count)
+    {
+        constexpr float kSpacing = 1.5f;
+        constexpr float kHeight = 5.0f;
+
+        const auto& handle = world.get<res::PhysicsHandleComponent>();
+        for (int index = 0; index < count; ++index)
+        {
+            const flecs::entity ball = world.entity()
+                                            .add<res::MatrixComponent>()
+                                            .add<res::PhysicsBodyIdComponent>()
+                                            .add<res::RigidbodySphereComponent>();
+            // Balls are created at the same spot, spread them out before they are added to the simulation
+            const Vector3 position = GetGridPosition(index, count, kSpacing, kHeight);
+            handle.body_interface->SetPosition(ball.get<res::PhysicsBodyIdComponent>().body_id,
+                                               JPH::RVec3(position.x, position.y, position.z),
+                                               JPH::EActivation::DontActivate);
+        }
+    }
+
+    void BM_PhysicsInit(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            BenchmarkWorld world;
+            benchmark::DoNotOptimize(world.GetWorld().get<res::PhysicsHandleComponent>().physics_system.get());
+        }
+    }
+    BENCHMARK(BM_PhysicsInit)->Unit(benchmark::kMillisecond);
+
+    void BM_FallingBalls(benchmark::State& state)
+    {
+        const auto ball_count = static_cast<int>(state.range(0));
+        BenchmarkWorld world;
+        world.AddFloor();
+        SpawnBalls(world.GetWorld(), ball_count);
+        // Adds the queued bodies
+        world.Step();
+
+        const std::uint64_t allocations_before = res::GetTotalAllocationCount();
+        for (auto _ : state)
+        {
+            world.Step();
+        }
+
+        const auto& telemetry = world.GetWorld().get<res::PhysicsTelemetryComponent>();
+        state.counters["allocations_per_step"] = benchmark::Counter(
+            static_cast<double>(res::GetTotalAllocationCount() - allocations_before),
+            benchmark::Counter::kAvgIterations);
+        state.counters["bodies"] = static_cast<double>(telemetry.num_bodies);
+        state.counters["active_bodies"] = static_cast<double>(telemetry.num_active_bodies);
+        state.counters["peak_contacts"] = static_cast<double>(telemetry.peak_contacts);
+        state.SetItemsProcessed(state.iterations() * ball_count);
+    }
+    BENCHMARK(BM_FallingBalls)->Arg(256)->Arg(1024)->Arg(4096)->Unit(benchmark::kMillisecond);
+
+    void BM_MeshColliderCooking(benchmark::State& state)
+    {
+        constexpr int kResolution = 32;
+        constexpr float kSpacing = 40.0f;
+
+        const auto mesh_count = static_cast<int>(state.range(0));
+        std::vector<std::unique_ptr<GeneratedMesh>> meshes;
+        for (int index = 0; index < mesh_count; ++index)
+        {
+            meshes.push_back(GenerateHeightFieldMesh(kResolution, index));
+        }
+
+        int loading_frames = 0;
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            auto world = std::make_unique<BenchmarkWorld>();
+            state.ResumeTiming();
+
+            for (int index = 0; index < mesh_count; ++index)
+            {
+                const Vector3 position = GetGridPosition(index, mesh_count, kSpacing, 0.0f);
+                world->GetWorld()
+                     .entity()
+                     .set<res::MatrixComponent>({MatrixTranslate(position.x, position.y, position.z)})
+                     .set<res::ModelComponent>({meshes[index]->model})
+                     .add<res::PhysicsBodyIdComponent>()
+                     .add<res::MeshColliderComponent>();
+            }
+
+            loading_frames = 0;
+            do
+            {
+                world->Step();
+                ++loading_frames;
+            }
+            while (world->GetWorld().get<res::MeshColliderLoadingComponent>().pending_bodies > 0 &&
+                   loading_frames < kMaxLoadingFrames);
+
+            state.PauseTiming();
+            world.reset();
+            state.ResumeTiming();
+        }
+
+        state.counters["loading_frames"] = loading_frames;
+        state.SetItemsProcessed(state.iterations() * mesh_count);
+    }
+    BENCHMARK(BM_MeshColliderCooking)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond);
+
+    void BM_CharacterCrowd(benchmark::State& state)
+    {
+        constexpr float kSpacing = 1.5f;
+
+        const auto character_count = static_cast<int>(state.range(0));
+        BenchmarkWorld world;
+        world.AddFloor();
+        for (int index = 0; index < character_count; ++index)
+        {
+            // Everyone walks to the center, so the crowd ends up pushing against itself
+            const Vector3 position = GetGridPosition(index, character_count, kSpacing, 0.0f);
+            world.GetWorld()
+                 .entity()
+                 .set<res::MatrixComponent>({MatrixTranslate(position.x, position.y, position.z)})
+                 .set<res::MovementInputComponent>({Vector2Normalize({-position.x, -position.z})})
+                 .set<res::CharacterControllerComponent>({});
+        }
+
+        const std::uint64_t allocations_before = res::GetTotalAllocationCount();
+        for (auto _ : state)
+        {
+            world.Step();
+        }
+
+        state.counters["allocations_per_step"] = benchmark::Counter(
+            static_cast<double>(res::GetTotalAllocationCount() - allocations_before),
+            benchmark::Counter::kAvgIterations);
+        state.counters["characters"] = static_cast<double>(
+            world.GetWorld().get<res::PhysicsTelemetryComponent>().num_characters);
+        state.SetItemsProcessed(state.iterations() * character_count);
+    }
+    BENCHMARK(BM_CharacterCrowd)->Arg(64)->Arg(256)->Arg(1024)->Unit(benchmark::kMillisecond);
+
+    void BM_EntitySpawnTeardown(benchmark::State& state)
+    {
+        const auto entity_count = static_cast<int>(state.range(0));
+        BenchmarkWorld world;
+        flecs::world& ecs = world.GetWorld();
+
+        for (auto _ : state)
+        {
+            for (int index = 0; index < entity_count; ++index)
+            {
+                ecs.entity()
+                   .set<res::LocalTransformComponent>({{static_cast<float>(index), 0.0f, 0.0f}})
+                   .set<res::ColorComponent>({BLUE});
+            }
+            world.Step();
+            ecs.delete_with<res::LocalTransformComponent>();
+        }
+
+        state.SetItemsProcessed(state.iterations() * entity_count);
+    }
+    BENCHMARK(BM_EntitySpawnTeardown)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+    // Roots each carrying a chain of children, a percentage of the roots moves every frame
+    void BM_TransformHierarchy(benchmark::State& state)
+    {
+        constexpr int kDepth = 4;
+
+        const auto root_count = static_cast<int>(state.range(0));
+        const auto moved_percent = static_cast<int>(state.range(1));
+        BenchmarkWorld world;
+        flecs::world& ecs = world.GetWorld();
+
+        std::vector<flecs::entity> roots;
+        roots.reserve(static_cast<std::size_t>(root_count));
+        for (int index = 0; index < root_count; ++index)
+        {
+            flecs::entity parent = ecs.entity().set<res::LocalTransformComponent>({});
+            roots.push_back(parent);
+            for (int depth = 0; depth < kDepth; ++depth)
+            {
+                parent = ecs.entity().child_of(parent).set<res::LocalTransformComponent>({{0.0f, 1.0f, 0.0f}});
+            }
+        }
+        world.Step();
+
+        const int moved_count = root_count * moved_percent / 100;
+        float time = 0.0f;
+        for (auto _ : state)
+        {
+            time += kFrameTime;
+            for (int index = 0; index < moved_count; ++index)
+            {
+                roots[index].set<res::LocalTransformComponent>({{std::sin(time), 0.0f, static_cast<float>(index)}});
+            }
+            world.Step();
+        }
+
+        state.SetItemsProcessed(state.iterations() * root_count * (kDepth + 1));
+    }
+    BENCHMARK(BM_TransformHierarchy)->Args({1000, 100})->Args({1000, 10})->Args({10000, 10})
+                                     ->Unit(benchmark::kMillisecond);
+
+    // Balls are created at the same spot, spread out like SpawnBalls before they are added to the simulation
+    void SpreadBalls(flecs::world& world)
+    {
+        constexpr float kSpacing = 1.5f;
+        constexpr float kHeight = 5.0f;
+
+        const auto& handle = world.get<res::PhysicsHandleComponent>();
+        const int ball_count = world.count<res::RigidbodySphereComponent>();
+        int index = 0;
+        world.each([&](const res::RigidbodySphereComponent&, const res::PhysicsBodyIdComponent& body_id_holder)
+        {
+            const Vector3 position = GetGridPosition(index++, ball_count, kSpacing, kHeight);
+            handle.body_interface->SetPosition(body_id_holder.body_id, JPH::RVec3(position.x, position.y, position.z),
+                                               JPH::EActivation::DontActivate);
+        });
+    }
+
+    // Saves a mixed world of transforms, hierarchies, texts and balls, deletes it and loads it back. Balls get new
+    // bodies through the physics observers, so loading includes their creation
+    void BM_WorldSnapshotRoundTrip(benchmark::State& state)
+    {
+        using Clock = std::chrono::steady_clock;
+        constexpr int kBallInterval = 10;
+        constexpr int kChildInterval = 8;
+        constexpr int kTextInterval = 16;
+
+        const auto entity_count = static_cast<int>(state.range(0));
+        BenchmarkWorld world;
+        flecs::world& ecs = world.GetWorld();
+        world.AddFloor();
+
+        // Every entity carries a color, so deleting by it clears the whole snapshot
+        flecs::entity parent{};
+        for (int index = 0; index < entity_count; ++index)
+        {
+            flecs::entity entity = ecs.entity().set<res::ColorComponent>({RED});
+            if (index % kBallInterval == 0)
+            {
+                entity.add<res::MatrixComponent>().add<res::PhysicsBodyIdComponent>()
+                      .add<res::RigidbodySphereComponent>();
+                continue;
+            }
+            if (index % kChildInterval == 0 && parent.is_valid())
+            {
+                entity.child_of(parent);
+            }
+            entity.set<res::LocalTransformComponent>({{static_cast<float>(index), 0.0f, 0.0f}});
+            if (index % kTextInterval == 0)
+            {
+                entity.set<res::TextComponent>({"Entity " + std::to_string(index)});
+            }
+            parent = entity;
+        }
+        SpreadBalls(ecs);
+        world.Step();
+
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / "res_benchmark.snapshot";
+        double save_ms = 0.0;
+        double load_ms = 0.0;
+        res::WorldSnapshotStats stats{};
+        for (auto _ : state)
+        {
+            const auto save_start = Clock::now();
+            if (!res::SaveWorldSnapshot(ecs, path, &stats))
+            {
+                state.SkipWithError("Saving the snapshot failed");
+                break;
+            }
+            const auto save_end = Clock::now();
+
+            state.PauseTiming();
+            ecs.delete_with<res::ColorComponent>();
+            state.ResumeTiming();
+
+            const auto load_start = Clock::now();
+            if (!res::LoadWorldSnapshot(ecs, path, &stats))
+            {
+                state.SkipWithError("Loading the snapshot failed");
+                break;
+            }
+            const auto load_end = Clock::now();
+
+            // Inserting the new bodies is part of the next frame, not of the load
+            state.PauseTiming();
+            world.Step();
+            state.ResumeTiming();
+
+            save_ms += std::chrono::duration<double, std::milli>(save_end - save_start).count();
+            load_ms += std::chrono::duration<double, std::milli>(load_end - load_start).count();
+        }
+        std::error_code error;
+        std::filesystem::remove(path, error);
+
+        if (stats.entity_count != static_cast<std::uint64_t>(entity_count) ||
+            ecs.count<res::ColorComponent>() != entity_count)
+        {
+            state.SkipWithError("The loaded world does not match the saved one");
+            return;
+        }
+        state.counters["save_ms"] = benchmark::Counter(save_ms, benchmark::Counter::kAvgIterations);
+        state.counters["load_ms"] = benchmark::Counter(load_ms, benchmark::Counter::kAvgIterations);
+        state.counters["snapshot_bytes"] = static_cast<double>(stats.byte_count);
+        state.counters["bodies"] = static_cast<double>(
+            world.GetWorld().get<res::PhysicsTelemetryComponent>().num_bodies);
+        state.SetItemsProcessed(state.iterations() * entity_count);
+    }
+    BENCHMARK(BM_WorldSnapshotRoundTrip)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+}
+
+int main(int argc, char** argv)
+{
+    // One scheduler for every benchmark world, the flecs hooks have to be installed before the first world
+    res::InstallEcsAllocator();
+    res::TaskScheduler scheduler{res::TaskSchedulerConfig{}};
+    scheduler.InstallEcsHooks();
+    benchmark_scheduler = &scheduler;
+#ifdef RES_PROFILER_ENABLED
+    // Recording would be measured along with the engine
+    res::Profiler::Get().SetEnabled(false);
+#endif
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::AddCustomContext("frame_time", std::to_string(kFrameTime));
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,274 @@
+#include "AssetCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#include "FileUtils.h"
+#include "HashUtils.h"
+
+
+namespace
+{
+    // raylib frees loaded file data with MemFree, so the buffers have to come from MemAlloc
+    unsigned char* CopyToRaylibBuffer(const void* data, const std::size_t size, const std::size_t padding)
+    {
+        auto* buffer = static_cast<unsigned char*>(MemAlloc(static_cast<unsigned int>(size + padding)));
+        if (buffer != nullptr && size > 0)
+        {
+            std::memcpy(buffer, data, size);
+        }
+        return buffer;
+    }
+}
+
+const res::AssetCache::PrefetchedFile* res::AssetCache::serving_file_ = nullptr;
+
+res::AssetCache::AssetCache(const int loader_thread_count)
+{
+    const int thread_count = std::max(loader_thread_count, 1);
+    loaders_.reserve(static_cast<std::size_t>(thread_count));
+    for (int thread_index = 0; thread_index < thread_count; ++thread_index)
+    {
+        loaders_.emplace_back(&AssetCache::LoaderMain, this);
+    }
+}
+
+res::AssetCache::~AssetCache()
+{
+    Shutdown(true);
+}
+
+void res::AssetCache::Shutdown(const bool unload_models)
+{
+    if (shut_down_)
+    {
+        return;
+    }
+    shut_down_ = true;
+
+    {
+        std::lock_guard lock{mutex_};
+        quit_ = true;
+    }
+    requests_wake_.notify_all();
+    for (std::thread& loader : loaders_)
+    {
+        loader.join();
+    }
+    loaders_.clear();
+
+    if (!unload_models)
+    {
+        return;
+    }
+    for (const auto& [path, asset] : assets_by_path_)
+    {
+        if (asset->status_ == AssetStatus::kReady && asset->source_ == nullptr)
+        {
+            UnloadModel(asset->model_);
+        }
+    }
+}
+
+res::ModelHandle res::AssetCache::RequestModel(const std::filesystem::path& path)
+{
+    const std::string key = path.lexically_normal().generic_string();
+    if (const auto it = assets_by_path_.find(key); it != assets_by_path_.end())
+    {
+        return it->second;
+    }
+
+    auto asset = std::make_shared<ModelAsset>(path);
+    assets_by_path_.emplace(key, asset);
+    ++progress_.requested_assets;
+    {
+        std::lock_guard lock{mutex_};
+        requests_.push_back(asset);
+    }
+    requests_wake_.notify_one();
+    return asset;
+}
+
+void res::AssetCache::Update(const double budget_ms)
+{
+    const auto start = std::chrono::steady_clock::now();
+    bool loaded_any = false;
+    while (true)
+    {
+        if (loaded_any && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+            >= budget_ms)
+        {
+            break;
+        }
+
+        PrefetchedFile file;
+        {
+            std::lock_guard lock{mutex_};
+            if (prefetched_.empty())
+            {
+                break;
+            }
+            file = std::move(prefetched_.front());
+            prefetched_.pop_front();
+        }
+        LoadPrefetched(file);
+        loaded_any = true;
+    }
+
+    CollectUnused();
+}
+
+void res::AssetCache::LoaderMain()
+{
+    while (true)
+    {
+        std::shared_ptr<ModelAsset> asset;
+        {
+            std::unique_lock lock{mutex_};
+            requests_wake_.wait(lock, [this] { return quit_ || !requests_.empty(); });
+            if (quit_)
+            {
+                return;
+            }
+            asset = std::move(requests_.front());
+            requests_.pop_front();
+        }
+
+        // The path is never written after the request, so reading it here is safe
+        PrefetchedFile file{asset};
+        const MappedFile mapped_file{asset->path_};
+        if (mapped_file.IsOpen())
+        {
+            const auto* bytes = reinterpret_cast<const unsigned char*>(mapped_file.GetData());
+            file.data.assign(bytes, bytes + mapped_file.GetSize());
+            file.content_hash = HashBytes(file.data.data(), file.data.size());
+            file.read = true;
+        }
+
+        std::lock_guard lock{mutex_};
+        prefetched_.push_back(std::move(file));
+    }
+}
+
+void res::AssetCache::LoadPrefetched(const PrefetchedFile& file)
+{
+    ModelAsset& asset = *file.asset;
+    if (!file.read)
+    {
+        spdlog::error("Failed to read model {}", asset.path_.string());
+        asset.status_ = AssetStatus::kFailed;
+        return;
+    }
+
+    asset.content_hash_ = file.content_hash;
+    if (const auto it = assets_by_hash_.find(file.content_hash); it != assets_by_hash_.end())
+    {
+        if (auto source = it->second.lock(); source != nullptr && source->status_ == AssetStatus::kReady)
+        {
+            asset.source_ = std::move(source);
+            asset.status_ = AssetStatus::kReady;
+            ++progress_.shared_assets;
+            return;
+        }
+    }
+
+    // Referenced files like materials and buffers are still read from disk by the callbacks
+    serving_file_ = &file;
+    SetLoadFileDataCallback(LoadFileDataCallback);
+    SetLoadFileTextCallback(LoadFileTextCallback);
+    asset.model_ = LoadModel(asset.path_.string().c_str());
+    SetLoadFileDataCallback(nullptr);
+    SetLoadFileTextCallback(nullptr);
+    serving_file_ = nullptr;
+
+    if (!IsModelValid(asset.model_))
+    {
+        spdlog::error("Failed to load model {}", asset.path_.string());
+        asset.status_ = AssetStatus::kFailed;
+        return;
+    }
+
+    asset.bounds_ = GetModelBoundingBox(asset.model_);
+    asset.status_ = AssetStatus::kReady;
+    assets_by_hash_[file.content_hash] = file.asset;
+    ++progress_.loaded_assets;
+}
+
+void res::AssetCache::CollectUnused()
+{
+    // Assets still queued for a loader are referenced by the queue as well
+    for (auto it = assets_by_path_.begin(); it != assets_by_path_.end();)
+    {
+        const std::shared_ptr<ModelAsset>& asset = it->second;
+        if (asset.use_count() > 1 || asset->status_ == AssetStatus::kPending)
+        {
+            ++it;
+            continue;
+        }
+
+        if (asset->status_ == AssetStatus::kReady && asset->source_ == nullptr)
+        {
+            UnloadModel(asset->model_);
+            if (const auto hash_it = assets_by_hash_.find(asset->content_hash_);
+                hash_it != assets_by_hash_.end() && hash_it->second.lock() == asset)
+            {
+                assets_by_hash_.erase(hash_it);
+            }
+        }
+        it = assets_by_path_.erase(it);
+    }
+    progress_.resident_assets = static_cast<std::uint32_t>(assets_by_path_.size());
+}
+
+unsigned char* res::AssetCache::LoadFileDataCallback(const char* file_name, int* data_size)
+{
+    *data_size = 0;
+    if (serving_file_ != nullptr && serving_file_->asset->path_.string() == file_name)
+    {
+        *data_size = static_cast<int>(serving_file_->data.size());
+        return CopyToRaylibBuffer(serving_file_->data.data(), serving_file_->data.size(), 0);
+    }
+
+    const MappedFile mapped_file{file_name};
+    if (!mapped_file.IsOpen())
+    {
+        spdlog::error("Failed to read file {}", file_name);
+        return nullptr;
+    }
+    *data_size = static_cast<int>(mapped_file.GetSize());
+    return CopyToRaylibBuffer(mapped_file.GetData(), mapped_file.GetSize(), 0);
+}
+
+char* res::AssetCache::LoadFileTextCallback(const char* file_name)
+{
+    const void* data = nullptr;
+    std::size_t size = 0;
+    MappedFile mapped_file;
+    if (serving_file_ != nullptr && serving_file_->asset->path_.string() == file_name)
+    {
+        data = serving_file_->data.data();
+        size = serving_file_->data.size();
+    }
+    else
+    {
+        mapped_file = MappedFile{file_name};
+        if (!mapped_file.IsOpen())
+        {
+            spdlog::error("Failed to read file {}", file_name);
+            return nullptr;
+        }
+        data = mapped_file.GetData();
+        size = mapped_file.GetSize();
+    }
+
+    unsigned char* text = CopyToRaylibBuffer(data, size, 1);
+    if (text != nullptr)
+    {
+        text[size] = '\0';
+    }
+    return reinterpret_cast<char*>(text);
+}
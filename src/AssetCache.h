@@ -0,0 +1,125 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <raylib.h>
+
+namespace res
+{
+    enum class AssetStatus
+    {
+        kPending,
+        kReady,
+        kFailed
+    };
+
+    struct AssetCacheProgress
+    {
+        std::uint32_t requested_assets{0};
+        std::uint32_t loaded_assets{0};
+        // Requests answered by a model already loaded from a file with the same content
+        std::uint32_t shared_assets{0};
+        std::uint32_t resident_assets{0};
+    };
+
+    // Model shared by every entity that requested the same path, or a path with the same content. Only the main
+    // thread reads or writes it
+    class ModelAsset
+    {
+    public:
+        explicit ModelAsset(std::filesystem::path path):
+            path_{std::move(path)}
+        {
+        }
+
+        [[nodiscard]] AssetStatus GetStatus() const { return status_; }
+        [[nodiscard]] const std::filesystem::path& GetPath() const { return path_; }
+        [[nodiscard]] std::uint64_t GetContentHash() const { return content_hash_; }
+        // Only valid once the asset is ready
+        [[nodiscard]] const Model& GetModel() const { return source_ != nullptr ? source_->model_ : model_; }
+        [[nodiscard]] const BoundingBox& GetBounds() const { return source_ != nullptr ? source_->bounds_ : bounds_; }
+
+    private:
+        friend class AssetCache;
+
+        std::filesystem::path path_;
+        std::uint64_t content_hash_{0};
+        AssetStatus status_{AssetStatus::kPending};
+        Model model_{};
+        // Computed once here instead of for every entity using the model
+        BoundingBox bounds_{};
+        // Set when a file with the same content was loaded first, the model is borrowed from it
+        std::shared_ptr<const ModelAsset> source_;
+    };
+
+    using ModelHandle = std::shared_ptr<const ModelAsset>;
+
+    // Models keyed by path and content hash and shared through reference-counted handles. Loader threads read and
+    // hash the files, the main thread parses and uploads the prefetched bytes within a time budget per frame and
+    // unloads models once the last handle is gone. raylib's loaders upload while they parse, so parsing can not
+    // leave the main thread, but it never waits on the disk
+    class AssetCache
+    {
+    public:
+        explicit AssetCache(int loader_thread_count);
+        // Calls Shutdown(true) unless it ran before, so it needs the window and should outlive the handles
+        ~AssetCache();
+
+        AssetCache(const AssetCache&) = delete;
+        AssetCache& operator=(const AssetCache&) = delete;
+
+        // Main thread only. Returns the existing handle when the path was requested before
+        [[nodiscard]] ModelHandle RequestModel(const std::filesystem::path& path);
+
+        // Main thread only. Loads prefetched models until budget_ms is used up, at least one per call, and unloads
+        // models nobody holds a handle to anymore
+        void Update(double budget_ms);
+
+        [[nodiscard]] AssetCacheProgress GetProgress() const { return progress_; }
+
+        // Stops and joins the loader threads, then unloads every model when unload_models is set. Without a GL
+        // context the models have to be left alone. Only the first call does anything
+        void Shutdown(bool unload_models);
+
+    private:
+        struct PrefetchedFile
+        {
+            std::shared_ptr<ModelAsset> asset;
+            std::vector<unsigned char> data;
+            std::uint64_t content_hash{0};
+            bool read{false};
+        };
+
+        void LoaderMain();
+        void LoadPrefetched(const PrefetchedFile& file);
+        void CollectUnused();
+
+        static unsigned char* LoadFileDataCallback(const char* file_name, int* data_size);
+        static char* LoadFileTextCallback(const char* file_name);
+
+        std::unordered_map<std::string, std::shared_ptr<ModelAsset>> assets_by_path_;
+        std::unordered_map<std::uint64_t, std::weak_ptr<const ModelAsset>> assets_by_hash_;
+        AssetCacheProgress progress_{};
+
+        std::mutex mutex_;
+        std::condition_variable requests_wake_;
+        std::deque<std::shared_ptr<ModelAsset>> requests_;
+        std::deque<PrefetchedFile> prefetched_;
+        std::vector<std::thread> loaders_;
+        bool quit_{false};
+        bool shut_down_{false};
+
+        // The file raylib's load callbacks answer from memory while LoadModel runs
+        static const PrefetchedFile* serving_file_;
+    };
+}
@@ -0,0 +1,358 @@
+#include "CharacterCrowd.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <Jolt/Core/Color.h>
+#include <Jolt/Geometry/RayAABox.h>
+#include <Jolt/Physics/Body/BodyFilter.h>
+#include <Jolt/Physics/Collision/CollideShape.h>
+#include <Jolt/Physics/Collision/CollisionDispatch.h>
+#include <Jolt/Physics/Collision/ShapeCast.h>
+#include <Jolt/Physics/Collision/ShapeFilter.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <spdlog/spdlog.h>
+
+
+namespace
+{
+    // Same velocity rules as the Jolt character samples: stick to the ground while standing on it, otherwise keep
+    // the vertical velocity and fall. Horizontal movement always comes from the input
+    JPH::Vec3 SetCharacterVelocity(JPH::CharacterVirtual& character, const JPH::Vec3 desired_velocity,
+                                   const float delta_time, const JPH::Vec3 gravity)
+    {
+        character.UpdateGroundVelocity();
+
+        const JPH::Vec3 up = character.GetUp();
+        const JPH::Vec3 vertical_velocity = up.Dot(character.GetLinearVelocity()) * up;
+        const JPH::Vec3 ground_velocity = character.GetGroundVelocity();
+        const bool moving_towards_ground = (vertical_velocity.GetY() - ground_velocity.GetY()) < 0.1f;
+
+        JPH::Vec3 new_velocity = character.GetGroundState() == JPH::CharacterBase::EGroundState::OnGround &&
+                                 moving_towards_ground
+                                     ? ground_velocity
+                                     : vertical_velocity;
+        new_velocity += gravity * delta_time;
+        new_velocity += desired_velocity;
+        character.SetLinearVelocity(new_velocity);
+        return new_velocity;
+    }
+
+    void MoveCharacter(JPH::CharacterVirtual& character, const float delta_time, const JPH::Vec3 gravity,
+                       const JPH::ObjectLayer object_layer, const JPH::PhysicsSystem& physics_system,
+                       JPH::TempAllocator& temp_allocator)
+    {
+        const JPH::CharacterVirtual::ExtendedUpdateSettings update_settings{};
+        character.ExtendedUpdate(delta_time, gravity, update_settings,
+                                 physics_system.GetDefaultBroadPhaseLayerFilter(object_layer),
+                                 physics_system.GetDefaultLayerFilter(object_layer), JPH::BodyFilter{},
+                                 JPH::ShapeFilter{}, temp_allocator);
+    }
+}
+
+res::CharacterCrowd::CharacterCrowd(const CharacterCrowdSettings& settings):
+    settings_{settings}
+{
+    characters_.reserve(settings_.max_characters);
+    snapshots_.reserve(settings_.max_characters);
+}
+
+bool res::CharacterCrowd::Add(JPH::CharacterVirtual* character)
+{
+    if (characters_.size() >= settings_.max_characters)
+    {
+        spdlog::error("Failed to add a character, the crowd limit of {} is reached!", settings_.max_characters);
+        return false;
+    }
+    characters_.push_back(character);
+    character->SetCharacterVsCharacterCollision(this);
+    return true;
+}
+
+void res::CharacterCrowd::Remove(const JPH::CharacterVirtual* character)
+{
+    const auto it = std::find(characters_.begin(), characters_.end(), character);
+    if (it == characters_.end())
+    {
+        return;
+    }
+    (*it)->SetCharacterVsCharacterCollision(nullptr);
+    *it = characters_.back();
+    characters_.pop_back();
+}
+
+void res::CharacterCrowd::Update(const std::vector<CharacterMove>& moves, const float delta_time,
+                                 const JPH::PhysicsSystem& physics_system, JPH::JobSystem& job_system)
+{
+    BuildSnapshot();
+    if (moves.empty() || delta_time <= 0.0f)
+    {
+        return;
+    }
+
+    // Velocities are set up front, the contact collector of a neighbour reads them while it moves
+    const JPH::Vec3 gravity = physics_system.GetGravity();
+    float max_speed = 0.0f;
+    for (const CharacterMove& move : moves)
+    {
+        const JPH::Vec3 velocity = SetCharacterVelocity(*move.character, move.desired_velocity, delta_time, gravity);
+        max_speed = std::max(max_speed, velocity.Length());
+    }
+
+    // Characters are bucketed into regions wide enough that two of them can only touch within the same region
+    // or in adjacent ones. Regions are colored in a 2x2 pattern and updated one color at a time, so regions that
+    // move concurrently never share a neighbour. The grid cell size is added as margin for stair steps
+    const float region_size = 2.0f * (max_half_extent_ + max_speed * delta_time) + settings_.grid_cell_size;
+    schedule_.clear();
+    for (std::uint32_t move_index = 0; move_index < moves.size(); ++move_index)
+    {
+        const JPH::RVec3 position = moves[move_index].character->GetPosition();
+        const auto region_x = static_cast<std::int32_t>(std::floor(static_cast<float>(position.GetX()) / region_size));
+        const auto region_z = static_cast<std::int32_t>(std::floor(static_cast<float>(position.GetZ()) / region_size));
+        const auto color = static_cast<std::uint32_t>((region_x & 1) | ((region_z & 1) << 1));
+        const std::uint64_t region = (static_cast<std::uint64_t>(static_cast<std::uint32_t>(region_x)) << 32) |
+            static_cast<std::uint32_t>(region_z);
+        schedule_.push_back({color, region, move_index});
+    }
+    std::sort(schedule_.begin(), schedule_.end(), [](const ScheduledMove& lhs, const ScheduledMove& rhs)
+    {
+        return lhs.color != rhs.color ? lhs.color < rhs.color : lhs.region < rhs.region;
+    });
+
+    const auto max_batches = static_cast<std::size_t>(std::max(job_system.GetMaxConcurrency(), 1));
+    const std::size_t batch_size = std::max<std::size_t>(settings_.batch_size, 1);
+    auto update_batch = [this, &moves, delta_time, gravity, &physics_system](const std::size_t begin,
+                                                                             const std::size_t end,
+                                                                             const std::size_t batch_index)
+    {
+        JPH::TempAllocator& temp_allocator = *temp_allocators_[batch_index];
+        for (std::size_t index = begin; index < end; ++index)
+        {
+            MoveCharacter(*moves[schedule_[index].move_index].character, delta_time, gravity, settings_.object_layer,
+                          physics_system, temp_allocator);
+        }
+    };
+
+    for (std::size_t color_begin = 0; color_begin < schedule_.size();)
+    {
+        std::size_t color_end = color_begin;
+        while (color_end < schedule_.size() && schedule_[color_end].color == schedule_[color_begin].color)
+        {
+            ++color_end;
+        }
+
+        // Batches of about batch_size moves, only ever split between regions
+        const std::size_t color_count = color_end - color_begin;
+        const std::size_t batch_count = std::min((color_count + batch_size - 1) / batch_size, max_batches);
+        const std::size_t moves_per_batch = (color_count + batch_count - 1) / batch_count;
+        batches_.clear();
+        std::size_t batch_begin = color_begin;
+        while (batch_begin < color_end)
+        {
+            std::size_t batch_end = std::min(batch_begin + moves_per_batch, color_end);
+            while (batch_end < color_end && schedule_[batch_end].region == schedule_[batch_end - 1].region)
+            {
+                ++batch_end;
+            }
+            batches_.emplace_back(batch_begin, batch_end);
+            batch_begin = batch_end;
+        }
+
+        // TempAllocatorImpl is not thread safe, every batch gets one of its own
+        while (temp_allocators_.size() < batches_.size())
+        {
+            temp_allocators_.push_back(std::make_unique<JPH::TempAllocatorImpl>(settings_.temp_allocator_size));
+        }
+
+        if (batches_.size() == 1)
+        {
+            update_batch(batches_[0].first, batches_[0].second, 0);
+        }
+        else
+        {
+            JPH::JobSystem::Barrier* barrier = job_system.CreateBarrier();
+            for (std::size_t batch_index = 0; batch_index < batches_.size(); ++batch_index)
+            {
+                const std::size_t begin = batches_[batch_index].first;
+                const std::size_t end = batches_[batch_index].second;
+                const JPH::JobHandle job = job_system.CreateJob("Update Characters", JPH::Color::sCyan,
+                                                                [&update_batch, begin, end, batch_index]()
+                                                                {
+                                                                    update_batch(begin, end, batch_index);
+                                                                });
+                barrier->AddJob(job);
+            }
+            job_system.WaitForJobs(barrier);
+            job_system.DestroyBarrier(barrier);
+        }
+        color_begin = color_end;
+    }
+}
+
+void res::CharacterCrowd::BuildSnapshot()
+{
+    snapshots_.clear();
+    cells_.clear();
+    max_half_extent_ = 0.0f;
+
+    for (const JPH::CharacterVirtual* character : characters_)
+    {
+        Snapshot& snapshot = snapshots_.emplace_back();
+        snapshot.character = character;
+        snapshot.shape = character->GetShape();
+        snapshot.center_of_mass_transform = character->GetCenterOfMassTransform();
+        snapshot.bounds = snapshot.shape->GetWorldSpaceBounds(snapshot.center_of_mass_transform, JPH::Vec3::sOne());
+        snapshot.padding = character->GetCharacterPadding();
+
+        const JPH::Vec3 extent = snapshot.bounds.GetExtent();
+        max_half_extent_ = std::max({max_half_extent_, extent.GetX() + snapshot.padding,
+                                     extent.GetZ() + snapshot.padding});
+    }
+
+    std::sort(snapshots_.begin(), snapshots_.end(), [this](const Snapshot& lhs, const Snapshot& rhs)
+    {
+        return GetCellKey(lhs.bounds.GetCenter()) < GetCellKey(rhs.bounds.GetCenter());
+    });
+
+    std::uint32_t begin = 0;
+    while (begin < snapshots_.size())
+    {
+        const std::uint64_t key = GetCellKey(snapshots_[begin].bounds.GetCenter());
+        std::uint32_t end = begin + 1;
+        while (end < snapshots_.size() && GetCellKey(snapshots_[end].bounds.GetCenter()) == key)
+        {
+            ++end;
+        }
+        cells_.emplace(key, std::pair{begin, end});
+        begin = end;
+    }
+}
+
+std::uint64_t res::CharacterCrowd::GetCellKey(const JPH::Vec3Arg position) const
+{
+    const auto cell_x = static_cast<std::int32_t>(std::floor(position.GetX() / settings_.grid_cell_size));
+    const auto cell_z = static_cast<std::int32_t>(std::floor(position.GetZ() / settings_.grid_cell_size));
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cell_x)) << 32) |
+        static_cast<std::uint32_t>(cell_z);
+}
+
+template <typename Visitor>
+void res::CharacterCrowd::VisitNeighbours(const JPH::AABox& bounds, Visitor&& visitor) const
+{
+    // Snapshots live in the cell of their center, so widen the search by the largest character
+    const float min_x = std::floor((bounds.mMin.GetX() - max_half_extent_) / settings_.grid_cell_size);
+    const float max_x = std::floor((bounds.mMax.GetX() + max_half_extent_) / settings_.grid_cell_size);
+    const float min_z = std::floor((bounds.mMin.GetZ() - max_half_extent_) / settings_.grid_cell_size);
+    const float max_z = std::floor((bounds.mMax.GetZ() + max_half_extent_) / settings_.grid_cell_size);
+
+    // Long sweeps cover more cells than there are characters, walking the whole list is cheaper then
+    if ((max_x - min_x + 1.0f) * (max_z - min_z + 1.0f) > static_cast<float>(cells_.size()))
+    {
+        for (const Snapshot& snapshot : snapshots_)
+        {
+            visitor(snapshot);
+        }
+        return;
+    }
+
+    for (auto cell_x = static_cast<std::int32_t>(min_x); cell_x <= static_cast<std::int32_t>(max_x); ++cell_x)
+    {
+        for (auto cell_z = static_cast<std::int32_t>(min_z); cell_z <= static_cast<std::int32_t>(max_z); ++cell_z)
+        {
+            const std::uint64_t key = (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cell_x)) << 32) |
+                static_cast<std::uint32_t>(cell_z);
+            const auto cell = cells_.find(key);
+            if (cell == cells_.end())
+            {
+                continue;
+            }
+            for (std::uint32_t index = cell->second.first; index < cell->second.second; ++index)
+            {
+                visitor(snapshots_[index]);
+            }
+        }
+    }
+}
+
+// Mirrors CharacterVsCharacterCollisionSimple, but reads the other characters from the snapshot. The contact
+// collector still reads the velocity of the other character, Update never moves two characters that can touch at
+// the same time and sets every velocity before the first one moves
+void res::CharacterCrowd::CollideCharacter(const JPH::CharacterVirtual* character,
+                                           const JPH::RMat44Arg center_of_mass_transform,
+                                           const JPH::CollideShapeSettings& collide_shape_settings,
+                                           const JPH::RVec3Arg base_offset,
+                                           JPH::CollideShapeCollector& collector) const
+{
+    const JPH::Mat44 transform1 = center_of_mass_transform.PostTranslated(-base_offset).ToMat44();
+    const JPH::Shape* shape = character->GetShape();
+    const JPH::AABox world_bounds = shape->GetWorldSpaceBounds(center_of_mass_transform, JPH::Vec3::sOne());
+    const JPH::AABox bounds = shape->GetWorldSpaceBounds(transform1, JPH::Vec3::sOne());
+    JPH::CollideShapeSettings settings = collide_shape_settings;
+
+    VisitNeighbours(world_bounds, [&](const Snapshot& other)
+    {
+        if (other.character == character || collector.ShouldEarlyOut())
+        {
+            return;
+        }
+
+        // Include the padding of the other character so its outer shell is detected
+        settings.mMaxSeparationDistance = collide_shape_settings.mMaxSeparationDistance + other.padding;
+
+        const JPH::Mat44 transform2 = other.center_of_mass_transform.PostTranslated(-base_offset).ToMat44();
+        JPH::AABox other_bounds = other.shape->GetWorldSpaceBounds(transform2, JPH::Vec3::sOne());
+        other_bounds.ExpandBy(JPH::Vec3::sReplicate(settings.mMaxSeparationDistance));
+        if (!bounds.Overlaps(other_bounds))
+        {
+            return;
+        }
+
+        collector.SetUserData(reinterpret_cast<JPH::uint64>(other.character));
+        JPH::CollisionDispatch::sCollideShapeVsShape(shape, other.shape, JPH::Vec3::sOne(),
+                                                     JPH::Vec3::sOne(), transform1, transform2,
+                                                     JPH::SubShapeIDCreator(), JPH::SubShapeIDCreator(), settings,
+                                                     collector);
+    });
+
+    collector.SetUserData(0);
+}
+
+void res::CharacterCrowd::CastCharacter(const JPH::CharacterVirtual* character,
+                                        const JPH::RMat44Arg center_of_mass_transform, const JPH::Vec3Arg direction,
+                                        const JPH::ShapeCastSettings& shape_cast_settings,
+                                        const JPH::RVec3Arg base_offset, JPH::CastShapeCollector& collector) const
+{
+    const JPH::Mat44 transform1 = center_of_mass_transform.PostTranslated(-base_offset).ToMat44();
+    const JPH::ShapeCast shape_cast(character->GetShape(), JPH::Vec3::sOne(), transform1, direction);
+    const JPH::Vec3 origin = shape_cast.mShapeWorldBounds.GetCenter();
+    const JPH::Vec3 extent = shape_cast.mShapeWorldBounds.GetExtent();
+
+    // The whole sweep in world space, for the grid lookup
+    JPH::AABox world_bounds = character->GetShape()->GetWorldSpaceBounds(center_of_mass_transform,
+                                                                        JPH::Vec3::sOne());
+    world_bounds.Encapsulate(JPH::AABox(world_bounds.mMin + direction, world_bounds.mMax + direction));
+
+    VisitNeighbours(world_bounds, [&](const Snapshot& other)
+    {
+        if (other.character == character || collector.ShouldEarlyOut())
+        {
+            return;
+        }
+
+        const JPH::Mat44 transform2 = other.center_of_mass_transform.PostTranslated(-base_offset).ToMat44();
+        JPH::AABox other_bounds = other.shape->GetWorldSpaceBounds(transform2, JPH::Vec3::sOne());
+        other_bounds.ExpandBy(extent);
+        if (!JPH::RayAABoxHits(origin, direction, other_bounds.mMin, other_bounds.mMax))
+        {
+            return;
+        }
+
+        collector.SetUserData(reinterpret_cast<JPH::uint64>(other.character));
+        JPH::CollisionDispatch::sCastShapeVsShapeWorldSpace(shape_cast, shape_cast_settings,
+                                                            other.shape, JPH::Vec3::sOne(),
+                                                            JPH::ShapeFilter{}, transform2, JPH::SubShapeIDCreator(),
+                                                            JPH::SubShapeIDCreator(), collector);
+    });
+
+    collector.SetUserData(0);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/JobSystem.h>
+#include <Jolt/Core/TempAllocator.h>
+#include <Jolt/Geometry/AABox.h>
+#include <Jolt/Physics/Character/CharacterVirtual.h>
+
+#include "JoltUtils.h"
+
+namespace JPH
+{
+    class PhysicsSystem;
+}
+
+namespace res
+{
+    struct CharacterCrowdSettings
+    {
+        JPH::uint max_characters{1024};
+        // Minimum characters per update job, the crowd never uses more jobs than the job system has threads
+        JPH::uint batch_size{32};
+        JPH::uint temp_allocator_size{1024 * 1024};
+        float grid_cell_size{2.0f};
+        JPH::ObjectLayer object_layer{PhysicsObjectLayers::CHARACTER};
+    };
+
+    struct CharacterMove
+    {
+        JPH::CharacterVirtual* character{nullptr};
+        JPH::Vec3 desired_velocity{JPH::Vec3::sZero()};
+    };
+
+    // Owns character vs character collision for every CharacterVirtual in the world and updates them in parallel.
+    // Collision queries run against a snapshot of all character poses taken before the update, bucketed in a
+    // uniform grid on the XZ plane, so a character only tests the neighbours around it and jobs never read a pose
+    // that another job is writing. Characters close enough to touch are never moved by two jobs at the same time
+    class CharacterCrowd final : public JPH::CharacterVsCharacterCollision
+    {
+    public:
+        explicit CharacterCrowd(const CharacterCrowdSettings& settings);
+
+        CharacterCrowd(const CharacterCrowd&) = delete;
+        CharacterCrowd& operator=(const CharacterCrowd&) = delete;
+
+        [[nodiscard]] bool Add(JPH::CharacterVirtual* character);
+        void Remove(const JPH::CharacterVirtual* character);
+        [[nodiscard]] std::size_t GetCharacterCount() const { return characters_.size(); }
+
+        // Must not run concurrently with a physics step
+        void Update(const std::vector<CharacterMove>& moves, float delta_time, const JPH::PhysicsSystem& physics_system,
+                    JPH::JobSystem& job_system);
+
+        void CollideCharacter(const JPH::CharacterVirtual* character, JPH::RMat44Arg center_of_mass_transform,
+                              const JPH::CollideShapeSettings& collide_shape_settings, JPH::RVec3Arg base_offset,
+                              JPH::CollideShapeCollector& collector) const override;
+        void CastCharacter(const JPH::CharacterVirtual* character, JPH::RMat44Arg center_of_mass_transform,
+                           JPH::Vec3Arg direction, const JPH::ShapeCastSettings& shape_cast_settings,
+                           JPH::RVec3Arg base_offset, JPH::CastShapeCollector& collector) const override;
+
+    private:
+        struct Snapshot
+        {
+            const JPH::CharacterVirtual* character{nullptr};
+            const JPH::Shape* shape{nullptr};
+            JPH::RMat44 center_of_mass_transform;
+            JPH::AABox bounds;
+            float padding{0.0f};
+        };
+
+        struct ScheduledMove
+        {
+            // Region parity, regions of the same color are never adjacent
+            std::uint32_t color{0};
+            std::uint64_t region{0};
+            std::uint32_t move_index{0};
+        };
+
+        void BuildSnapshot();
+        [[nodiscard]] std::uint64_t GetCellKey(JPH::Vec3Arg position) const;
+
+        // Calls visitor for every snapshot whose grid cell overlaps bounds
+        template <typename Visitor>
+        void VisitNeighbours(const JPH::AABox& bounds, Visitor&& visitor) const;
+
+        CharacterCrowdSettings settings_;
+        std::vector<JPH::CharacterVirtual*> characters_;
+        std::vector<Snapshot> snapshots_;
+        // Grid cell key to the range of snapshots_ in that cell, snapshots_ is sorted by cell
+        std::unordered_map<std::uint64_t, std::pair<std::uint32_t, std::uint32_t>> cells_;
+        float max_half_extent_{0.0f};
+        std::vector<std::unique_ptr<JPH::TempAllocatorImpl>> temp_allocators_;
+        // Scratch lists reused by Update
+        std::vector<ScheduledMove> schedule_;
+        std::vector<std::pair<std::size_t, std::size_t>> batches_;
+    };
+}
@@ -0,0 +1,203 @@
+#include "Culling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <numeric>
+
+#include <raymath.h>
+#include <rlgl.h>
+
+namespace {
+constexpr std::uint32_t kMaxLeafSize = 4;
+
+res::FrustumPlane MakePlane(const float a, const float b, const float c,
+                            const float d) {
+  const float length = std::sqrt(a * a + b * b + c * c);
+  return {{a / length, b / length, c / length}, d / length};
+}
+
+BoundingBox MergeBoxes(const BoundingBox &lhs, const BoundingBox &rhs) {
+  return {Vector3Min(lhs.min, rhs.min), Vector3Max(lhs.max, rhs.max)};
+}
+
+float GetSurfaceArea(const BoundingBox &box) {
+  const Vector3 size = Vector3Subtract(box.max, box.min);
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+float GetAxis(const Vector3 &vector, const int axis) {
+  return axis == 0 ? vector.x : (axis == 1 ? vector.y : vector.z);
+}
+} // namespace
+
+res::Frustum res::ExtractFrustum(const Matrix &view_projection) {
+  // Rows of the clip matrix, raylib stores m0, m4, m8, m12 as the first row
+  const Matrix &m = view_projection;
+  Frustum frustum{};
+  frustum.planes[0] = MakePlane(m.m3 + m.m0, m.m7 + m.m4, m.m11 + m.m8,
+                                m.m15 + m.m12); // Left
+  frustum.planes[1] = MakePlane(m.m3 - m.m0, m.m7 - m.m4, m.m11 - m.m8,
+                                m.m15 - m.m12); // Right
+  frustum.planes[2] = MakePlane(m.m3 + m.m1, m.m7 + m.m5, m.m11 + m.m9,
+                                m.m15 + m.m13); // Bottom
+  frustum.planes[3] = MakePlane(m.m3 - m.m1, m.m7 - m.m5, m.m11 - m.m9,
+                                m.m15 - m.m13); // Top
+  frustum.planes[4] = MakePlane(m.m3 + m.m2, m.m7 + m.m6, m.m11 + m.m10,
+                                m.m15 + m.m14); // Near
+  frustum.planes[5] = MakePlane(m.m3 - m.m2, m.m7 - m.m6, m.m11 - m.m10,
+                                m.m15 - m.m14); // Far
+  return frustum;
+}
+
+Matrix res::GetCameraViewProjection(const Camera3D &camera,
+                                    const float aspect) {
+  // Same projection BeginMode3D sets up
+  const double near_plane = rlGetCullDistanceNear();
+  const double far_plane = rlGetCullDistanceFar();
+  Matrix projection{};
+  if (camera.projection == CAMERA_ORTHOGRAPHIC) {
+    const double top = camera.fovy / 2.0;
+    const double right = top * aspect;
+    projection = MatrixOrtho(-right, right, -top, top, near_plane, far_plane);
+  } else {
+    projection = MatrixPerspective(camera.fovy * DEG2RAD, aspect, near_plane,
+                                   far_plane);
+  }
+  return MatrixMultiply(GetCameraMatrix(camera), projection);
+}
+
+res::FrustumTest res::TestFrustum(const Frustum &frustum,
+                                  const BoundingBox &box) {
+  FrustumTest result = FrustumTest::kInside;
+  for (const FrustumPlane &plane : frustum.planes) {
+    // Corner furthest along the plane normal, and the one opposite to it
+    const Vector3 positive{plane.normal.x >= 0.0f ? box.max.x : box.min.x,
+                           plane.normal.y >= 0.0f ? box.max.y : box.min.y,
+                           plane.normal.z >= 0.0f ? box.max.z : box.min.z};
+    if (Vector3DotProduct(plane.normal, positive) + plane.distance < 0.0f) {
+      return FrustumTest::kOutside;
+    }
+    const Vector3 negative{plane.normal.x >= 0.0f ? box.min.x : box.max.x,
+                           plane.normal.y >= 0.0f ? box.min.y : box.max.y,
+                           plane.normal.z >= 0.0f ? box.min.z : box.max.z};
+    if (Vector3DotProduct(plane.normal, negative) + plane.distance < 0.0f) {
+      result = FrustumTest::kIntersecting;
+    }
+  }
+  return result;
+}
+
+BoundingBox res::TransformBoundingBox(const BoundingBox &box,
+                                      const Matrix &transform) {
+  const Vector3 center = Vector3Scale(Vector3Add(box.min, box.max), 0.5f);
+  const Vector3 extent = Vector3Scale(Vector3Subtract(box.max, box.min), 0.5f);
+  const Vector3 world_center = Vector3Transform(center, transform);
+  const Vector3 world_extent{
+      std::abs(transform.m0) * extent.x + std::abs(transform.m4) * extent.y +
+          std::abs(transform.m8) * extent.z,
+      std::abs(transform.m1) * extent.x + std::abs(transform.m5) * extent.y +
+          std::abs(transform.m9) * extent.z,
+      std::abs(transform.m2) * extent.x + std::abs(transform.m6) * extent.y +
+          std::abs(transform.m10) * extent.z};
+  return {Vector3Subtract(world_center, world_extent),
+          Vector3Add(world_center, world_extent)};
+}
+
+void res::BoundingVolumeHierarchy::Build(
+    const std::vector<BoundingBox> &boxes) {
+  nodes_.clear();
+  surface_area_ = 0.0f;
+  box_indices_.resize(boxes.size());
+  std::iota(box_indices_.begin(), box_indices_.end(), 0u);
+  if (boxes.empty()) {
+    return;
+  }
+
+  // Only needed while the tree is built
+  FrameVector<Vector3> centers;
+  centers.reserve(boxes.size());
+  BoundingBox bounds = boxes.front();
+  for (const BoundingBox &box : boxes) {
+    centers.push_back(Vector3Scale(Vector3Add(box.min, box.max), 0.5f));
+    bounds = MergeBoxes(bounds, box);
+  }
+
+  nodes_.reserve(2 * boxes.size() / kMaxLeafSize + 1);
+  nodes_.push_back({bounds, 0, static_cast<std::uint32_t>(boxes.size())});
+  Split(0, boxes, centers);
+  for (const Node &node : nodes_) {
+    surface_area_ += GetSurfaceArea(node.bounds);
+  }
+}
+
+void res::BoundingVolumeHierarchy::Refit(
+    const std::vector<BoundingBox> &boxes) {
+  surface_area_ = 0.0f;
+  // Children are always stored after their parent
+  for (auto node_index = static_cast<std::int64_t>(nodes_.size()) - 1;
+       node_index >= 0; --node_index) {
+    Node &node = nodes_[node_index];
+    if (node.count > 0) {
+      node.bounds = boxes[box_indices_[node.first]];
+      for (std::uint32_t i = node.first + 1; i < node.first + node.count; ++i) {
+        node.bounds = MergeBoxes(node.bounds, boxes[box_indices_[i]]);
+      }
+    } else {
+      node.bounds =
+          MergeBoxes(nodes_[node.first].bounds, nodes_[node.first + 1].bounds);
+    }
+    surface_area_ += GetSurfaceArea(node.bounds);
+  }
+}
+
+void res::BoundingVolumeHierarchy::Split(const std::uint32_t node_index,
+                                         const std::vector<BoundingBox> &boxes,
+                                         const FrameVector<Vector3> &centers) {
+  const std::uint32_t first = nodes_[node_index].first;
+  const std::uint32_t count = nodes_[node_index].count;
+  if (count <= kMaxLeafSize) {
+    return;
+  }
+
+  // Median split along the longest axis of the box centers
+  Vector3 center_min = centers[box_indices_[first]];
+  Vector3 center_max = center_min;
+  for (std::uint32_t i = first + 1; i < first + count; ++i) {
+    center_min = Vector3Min(center_min, centers[box_indices_[i]]);
+    center_max = Vector3Max(center_max, centers[box_indices_[i]]);
+  }
+  const Vector3 size = Vector3Subtract(center_max, center_min);
+  const int axis = size.x >= size.y && size.x >= size.z ? 0
+                   : size.y >= size.z                   ? 1
+                                                        : 2;
+  if (GetAxis(size, axis) <= 0.0f) {
+    return;
+  }
+
+  const std::uint32_t left_count = count / 2;
+  const auto begin = box_indices_.begin() + first;
+  std::nth_element(begin, begin + left_count, begin + count,
+                   [&centers, axis](const std::uint32_t lhs,
+                                    const std::uint32_t rhs) {
+                     return GetAxis(centers[lhs], axis) <
+                            GetAxis(centers[rhs], axis);
+                   });
+
+  const auto left_index = static_cast<std::uint32_t>(nodes_.size());
+  nodes_.push_back({{}, first, left_count});
+  nodes_.push_back({{}, first + left_count, count - left_count});
+  for (const std::uint32_t child_index : {left_index, left_index + 1}) {
+    Node &child = nodes_[child_index];
+    child.bounds = boxes[box_indices_[child.first]];
+    for (std::uint32_t i = child.first + 1; i < child.first + child.count;
+         ++i) {
+      child.bounds = MergeBoxes(child.bounds, boxes[box_indices_[i]]);
+    }
+  }
+  nodes_[node_index].first = left_index;
+  nodes_[node_index].count = 0;
+
+  Split(left_index, boxes, centers);
+  Split(left_index + 1, boxes, centers);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <raylib.h>
+
+#include "FrameArena.h"
+
+namespace res {
+// Points with Dot(normal, point) + distance >= 0 are on the inner side
+struct FrustumPlane {
+  Vector3 normal{0.0f, 0.0f, 0.0f};
+  float distance{0.0f};
+};
+
+struct Frustum {
+  std::array<FrustumPlane, 6> planes{};
+};
+
+enum class FrustumTest { kOutside, kIntersecting, kInside };
+
+// view_projection is MatrixMultiply(view, projection), the clip space is
+// OpenGL's -w..w on every axis
+[[nodiscard]] Frustum ExtractFrustum(const Matrix &view_projection);
+// The view-projection raylib uses for camera with the current screen aspect
+[[nodiscard]] Matrix GetCameraViewProjection(const Camera3D &camera,
+                                             float aspect);
+[[nodiscard]] FrustumTest TestFrustum(const Frustum &frustum,
+                                      const BoundingBox &box);
+// Axis-aligned box enclosing box after transform
+[[nodiscard]] BoundingBox TransformBoundingBox(const BoundingBox &box,
+                                               const Matrix &transform);
+
+// Bounding volume hierarchy over a list of boxes. Build sorts the boxes into a
+// tree, Refit only updates the node bounds and is enough while the list keeps
+// the same boxes in the same order. A refit tree gets looser as boxes move away
+// from where they were built, GetSurfaceArea tells when to build again
+class BoundingVolumeHierarchy {
+public:
+  void Build(const std::vector<BoundingBox> &boxes);
+  void Refit(const std::vector<BoundingBox> &boxes);
+
+  // Calls visitor with the index of every box inside or touching the frustum,
+  // boxes must be the list the tree was last built or refit with
+  template <typename Visitor>
+  void Query(const Frustum &frustum, const std::vector<BoundingBox> &boxes,
+             Visitor &&visitor) const;
+
+  [[nodiscard]] std::size_t GetNodeCount() const { return nodes_.size(); }
+  // Summed surface area of every node as of the last Build or Refit
+  [[nodiscard]] float GetSurfaceArea() const { return surface_area_; }
+
+private:
+  struct Node {
+    BoundingBox bounds{};
+    // Leaves reference count boxes starting at first in box_indices_, inner
+    // nodes have count zero and their children at first and first + 1
+    std::uint32_t first{0};
+    std::uint32_t count{0};
+  };
+
+  void Split(std::uint32_t node_index, const std::vector<BoundingBox> &boxes,
+             const FrameVector<Vector3> &centers);
+  template <typename Visitor>
+  void VisitAll(const Node &node, Visitor &visitor) const;
+
+  std::vector<Node> nodes_;
+  std::vector<std::uint32_t> box_indices_;
+  float surface_area_{0.0f};
+};
+
+template <typename Visitor>
+void BoundingVolumeHierarchy::VisitAll(const Node &node,
+                                       Visitor &visitor) const {
+  if (node.count > 0) {
+    for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+      visitor(box_indices_[i]);
+    }
+    return;
+  }
+  VisitAll(nodes_[node.first], visitor);
+  VisitAll(nodes_[node.first + 1], visitor);
+}
+
+template <typename Visitor>
+void BoundingVolumeHierarchy::Query(const Frustum &frustum,
+                                    const std::vector<BoundingBox> &boxes,
+                                    Visitor &&visitor) const {
+  if (nodes_.empty()) {
+    return;
+  }
+
+  std::uint32_t stack[64];
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    const Node &node = nodes_[stack[--stack_size]];
+    const FrustumTest test = TestFrustum(frustum, node.bounds);
+    if (test == FrustumTest::kOutside) {
+      continue;
+    }
+    // Everything below a node that is fully inside is visible
+    if (test == FrustumTest::kInside) {
+      VisitAll(node, visitor);
+      continue;
+    }
+    if (node.count > 0) {
+      for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+        const std::uint32_t box_index = box_indices_[i];
+        if (TestFrustum(frustum, boxes[box_index]) != FrustumTest::kOutside) {
+          visitor(box_index);
+        }
+      }
+      continue;
+    }
+    stack[stack_size++] = node.first;
+    stack[stack_size++] = node.first + 1;
+  }
+}
+} // namespace res
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <flecs.h>
+
+namespace res
+{
+    // State of the entity inspector window
+    struct EntityInspectorComponent
+    {
+        // Index into the component filters of DebugSystems
+        int filter_index{0};
+        flecs::entity_t selected{0};
+    };
+}
@@ -1,17 +1,373 @@
 #include "DebugSystems.h"
 
+#include <algorithm>
 #include <cassert>
+#include <vector>
 
 #include <flecs.h>
 #include <imgui.h>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Body/BodyInterface.h>
 #include <rlImGui.h>
+#include <spdlog/spdlog.h>
 
+#include "CommonComponents.h"
+#include "DebugComponents.h"
+#include "FrameArena.h"
 #include "InputComponents.h"
 #include "MathUtils.h"
+#include "MemoryTracking.h"
 #include "PhysicsComponents.h"
+#include "Profiler.h"
 #include "RenderComponents.h"
 #include "TransformComponents.h"
+#include "UIComponents.h"
 
+namespace
+{
+    struct InspectorFilter
+    {
+        const char* name;
+        flecs::query<> query;
+    };
+
+    const char* GetEntityLabel(const flecs::entity entity)
+    {
+        const char* name = entity.name().c_str();
+        return name != nullptr && name[0] != '\0' ? name : "(unnamed)";
+    }
+
+    template <typename T>
+    InspectorFilter MakeInspectorFilter(flecs::world& world, const char* name)
+    {
+        return {name, world.query_builder<>().with<T>().cached().build()};
+    }
+
+    // Walks the tables of the query up to the rows the clipper shows, so the cost follows the visible rows and the
+    // table count rather than the entity count
+    void DrawEntityList(const flecs::query<>& query, res::EntityInspectorComponent& inspector)
+    {
+        ImGuiListClipper clipper;
+        clipper.Begin(query.count());
+        while (clipper.Step())
+        {
+            int row = 0;
+            query.run([&clipper, &inspector, &row](flecs::iter& it)
+            {
+                while (it.next())
+                {
+                    const auto table_count = static_cast<int>(it.count());
+                    if (row + table_count <= clipper.DisplayStart)
+                    {
+                        row += table_count;
+                        continue;
+                    }
+
+                    for (const auto i : it)
+                    {
+                        const int index = row + static_cast<int>(i);
+                        if (index < clipper.DisplayStart)
+                        {
+                            continue;
+                        }
+                        if (index >= clipper.DisplayEnd)
+                        {
+                            it.fini();
+                            return;
+                        }
+
+                        const flecs::entity entity = it.entity(i);
+                        ImGui::PushID(static_cast<int>(index));
+                        if (ImGui::Selectable(GetEntityLabel(entity), inspector.selected == entity.id()))
+                        {
+                            inspector.selected = entity.id();
+                        }
+                        ImGui::SameLine();
+                        ImGui::TextDisabled("#%llu", static_cast<unsigned long long>(entity.id()));
+                        ImGui::PopID();
+                    }
+                    row += table_count;
+                }
+            });
+        }
+    }
+
+    const char* GetMotionTypeName(const JPH::EMotionType motion_type)
+    {
+        switch (motion_type)
+        {
+        case JPH::EMotionType::Static:
+            return "Static";
+        case JPH::EMotionType::Kinematic:
+            return "Kinematic";
+        case JPH::EMotionType::Dynamic:
+            return "Dynamic";
+        }
+        return "Unknown";
+    }
+
+    void DrawBodyState(const flecs::world& world, const JPH::BodyID body_id)
+    {
+        const auto* handle = world.try_get<res::PhysicsHandleComponent>();
+        if (handle == nullptr || handle->body_interface == nullptr || body_id.IsInvalid()
+            || !handle->body_interface->IsAdded(body_id))
+        {
+            ImGui::Text("Body not in the simulation");
+            return;
+        }
+
+        const JPH::BodyInterface& body_interface = *handle->body_interface;
+        const JPH::RVec3 position = body_interface.GetPosition(body_id);
+        const JPH::Vec3 linear_velocity = body_interface.GetLinearVelocity(body_id);
+        const JPH::Vec3 angular_velocity = body_interface.GetAngularVelocity(body_id);
+        const JPH::ObjectLayer layer = body_interface.GetObjectLayer(body_id);
+        ImGui::Text("Body %u: %s, %s", body_id.GetIndex(), GetMotionTypeName(body_interface.GetMotionType(body_id)),
+                    body_interface.IsActive(body_id) ? "active" : "sleeping");
+        ImGui::Text("Object Layer: %s", handle->layer_registry != nullptr
+                                            ? handle->layer_registry->GetObjectLayerName(layer)
+                                            : "");
+        ImGui::Text("Body Position: %f,%f,%f", static_cast<float>(position.GetX()),
+                    static_cast<float>(position.GetY()), static_cast<float>(position.GetZ()));
+        ImGui::Text("Linear Velocity: %f,%f,%f", linear_velocity.GetX(), linear_velocity.GetY(),
+                    linear_velocity.GetZ());
+        ImGui::Text("Angular Velocity: %f,%f,%f", angular_velocity.GetX(), angular_velocity.GetY(),
+                    angular_velocity.GetZ());
+    }
+
+    // Values of the components the inspector knows about, every other component is only listed by name
+    void DrawEntityDetails(const flecs::world& world, const flecs::entity entity)
+    {
+        ImGui::Text("Entity #%llu %s", static_cast<unsigned long long>(entity.id()), GetEntityLabel(entity));
+        ImGui::TextWrapped("%s", entity.type().str().c_str());
+        ImGui::Separator();
+
+        if (const auto* matrix_component = entity.try_get<res::MatrixComponent>())
+        {
+            const auto [x, y, z] = res::GetPositionFromMatrix(matrix_component->matrix);
+            ImGui::Text("Position: %f,%f,%f", x, y, z);
+        }
+        if (const auto* local_transform = entity.try_get<res::LocalTransformComponent>())
+        {
+            const Vector3& translation = local_transform->translation;
+            const Vector3& scale = local_transform->scale;
+            ImGui::Text("Local Translation: %f,%f,%f", translation.x, translation.y, translation.z);
+            ImGui::Text("Local Scale: %f,%f,%f", scale.x, scale.y, scale.z);
+        }
+        if (const auto* movement_input = entity.try_get<res::MovementInputComponent>())
+        {
+            ImGui::Text("Movement Input: %f,%f", movement_input->input.x, movement_input->input.y);
+        }
+        if (const auto* visibility = entity.try_get<res::VisibilityComponent>())
+        {
+            ImGui::Text("Visible: %s", visibility->visible ? "yes" : "no");
+        }
+        if (const auto* color_component = entity.try_get<res::ColorComponent>())
+        {
+            const Color& color = color_component->color;
+            ImGui::Text("Color: %u,%u,%u,%u", color.r, color.g, color.b, color.a);
+        }
+        if (const auto* text_component = entity.try_get<res::TextComponent>())
+        {
+            ImGui::TextWrapped("Text: %s", text_component->text.c_str());
+        }
+        if (const auto* body_id_component = entity.try_get<res::PhysicsBodyIdComponent>())
+        {
+            DrawBodyState(world, body_id_component->body_id);
+        }
+    }
+
+    // Lists the entities matching the chosen component filter next to the values of the selected one
+    void DrawEntityInspectorWindow(const flecs::world& world, const std::vector<InspectorFilter>& filters,
+                                   res::EntityInspectorComponent& inspector)
+    {
+        if (!ImGui::Begin("Entity Inspector"))
+        {
+            ImGui::End();
+            return;
+        }
+
+        inspector.filter_index = std::clamp(inspector.filter_index, 0, static_cast<int>(filters.size()) - 1);
+        if (ImGui::BeginCombo("Filter", filters[inspector.filter_index].name))
+        {
+            for (int filter_index = 0; filter_index < static_cast<int>(filters.size()); ++filter_index)
+            {
+                if (ImGui::Selectable(filters[filter_index].name, filter_index == inspector.filter_index))
+                {
+                    inspector.filter_index = filter_index;
+                }
+            }
+            ImGui::EndCombo();
+        }
+
+        const flecs::query<>& query = filters[inspector.filter_index].query;
+        ImGui::Text("%d entities", query.count());
+
+        const float list_width = ImGui::GetContentRegionAvail().x * 0.4f;
+        if (ImGui::BeginChild("Entities", ImVec2(list_width, 0.0f), ImGuiChildFlags_Borders))
+        {
+            DrawEntityList(query, inspector);
+        }
+        ImGui::EndChild();
+
+        ImGui::SameLine();
+        if (ImGui::BeginChild("Details", ImVec2(0.0f, 0.0f), ImGuiChildFlags_Borders))
+        {
+            const flecs::entity selected{world.c_ptr(), inspector.selected};
+            if (inspector.selected != 0 && selected.is_alive())
+            {
+                DrawEntityDetails(world, selected);
+            }
+            else
+            {
+                ImGui::Text("No entity selected");
+            }
+        }
+        ImGui::EndChild();
+
+        ImGui::End();
+    }
+
+    // Live memory per tag and the allocations of the last frame, any of them on the hot path is worth a look
+    void DrawMemoryWindow()
+    {
+        if (!ImGui::Begin("Memory"))
+        {
+            ImGui::End();
+            return;
+        }
+
+        ImGui::Text("Allocations last frame: %llu",
+                    static_cast<unsigned long long>(res::GetLastFrameAllocationCount()));
+        ImGui::Text("Pool memory reserved: %.1f KiB", static_cast<double>(res::GetReservedPoolBytes()) / 1024.0);
+        const res::FrameArenaStats arena_stats = res::GetFrameArenaStats();
+        ImGui::Text("Frame arenas: %.1f KiB used, %.1f KiB high water, %.1f KiB reserved",
+                    static_cast<double>(arena_stats.used_bytes_last_frame) / 1024.0,
+                    static_cast<double>(arena_stats.high_water_mark) / 1024.0,
+                    static_cast<double>(arena_stats.capacity) / 1024.0);
+
+        if (ImGui::BeginTable("Memory Tags", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+        {
+            ImGui::TableSetupColumn("Tag");
+            ImGui::TableSetupColumn("Live KiB");
+            ImGui::TableSetupColumn("Live Blocks");
+            ImGui::TableSetupColumn("Total Allocations");
+            ImGui::TableHeadersRow();
+            for (std::size_t tag_index = 0; tag_index < res::kMemoryTagCount; ++tag_index)
+            {
+                const auto tag = static_cast<res::MemoryTag>(tag_index);
+                const res::MemoryTagStats stats = res::GetMemoryTagStats(tag);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(res::GetMemoryTagName(tag));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", static_cast<double>(stats.live_bytes) / 1024.0);
+                ImGui::TableNextColumn();
+                ImGui::Text("%lld", static_cast<long long>(stats.live_allocations));
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(stats.total_allocations));
+            }
+            ImGui::EndTable();
+        }
+
+        ImGui::End();
+    }
+}
+
+#ifdef RES_PROFILER_ENABLED
+namespace
+{
+    ImU32 GetProfileCategoryColor(const res::ProfileCategory category)
+    {
+        switch (category)
+        {
+        case res::ProfileCategory::kPhase:
+            return IM_COL32(90, 90, 160, 255);
+        case res::ProfileCategory::kSystem:
+            return IM_COL32(70, 150, 90, 255);
+        case res::ProfileCategory::kPhysics:
+            return IM_COL32(190, 120, 50, 255);
+        case res::ProfileCategory::kScope:
+            return IM_COL32(150, 70, 150, 255);
+        }
+        return IM_COL32_WHITE;
+    }
+
+    // Frame time graph over the history and a timeline of the last frame, one row per thread
+    void DrawProfilerWindow()
+    {
+        constexpr float kRowHeight = 18.0f;
+        constexpr float kTimelineHeight = 8 * kRowHeight;
+        constexpr const char* kTraceFileName = "profile_trace.json";
+
+        auto& profiler = res::Profiler::Get();
+        if (!ImGui::Begin("Profiler"))
+        {
+            ImGui::End();
+            return;
+        }
+
+        bool enabled = profiler.IsEnabled();
+        if (ImGui::Checkbox("Record", &enabled))
+        {
+            profiler.SetEnabled(enabled);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Export Trace") && profiler.ExportChromeTrace(kTraceFileName))
+        {
+            spdlog::info("Saved profile trace to {}", kTraceFileName);
+        }
+
+        const auto& frames = profiler.GetFrames();
+        if (frames.empty())
+        {
+            ImGui::Text("No frames recorded");
+            ImGui::End();
+            return;
+        }
+
+        res::FrameVector<float> frame_times_ms;
+        frame_times_ms.reserve(frames.size());
+        for (const res::ProfileFrame& frame : frames)
+        {
+            frame_times_ms.push_back(static_cast<float>(frame.end_ns - frame.start_ns) / 1.0e6f);
+        }
+        const float max_frame_time = *std::max_element(frame_times_ms.begin(), frame_times_ms.end());
+        ImGui::Text("Frame %.2f ms, max %.2f ms", frame_times_ms.back(), max_frame_time);
+        ImGui::PlotLines("##Frame Times", frame_times_ms.data(), static_cast<int>(frame_times_ms.size()), 0,
+                         nullptr, 0.0f, max_frame_time, ImVec2(-1.0f, 60.0f));
+
+        const res::ProfileFrame& frame = frames.back();
+        const auto frame_duration = static_cast<float>(frame.end_ns - frame.start_ns);
+        const ImVec2 origin = ImGui::GetCursorScreenPos();
+        const float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+        ImDrawList* draw_list = ImGui::GetWindowDrawList();
+        for (const res::ProfileEvent& event : frame.events)
+        {
+            if (event.start_ns < frame.start_ns || frame_duration <= 0.0f)
+            {
+                continue;
+            }
+            const float start = static_cast<float>(event.start_ns - frame.start_ns) / frame_duration * width;
+            const float end = static_cast<float>(event.end_ns - frame.start_ns) / frame_duration * width;
+            // Phases get a row of their own above the threads
+            const float row = event.category == res::ProfileCategory::kPhase
+                                  ? 0.0f
+                                  : static_cast<float>(event.thread_index + 1);
+            const ImVec2 min{origin.x + start, origin.y + row * kRowHeight};
+            const ImVec2 max{origin.x + std::max(end, start + 1.0f), min.y + kRowHeight - 1.0f};
+            draw_list->AddRectFilled(min, max, GetProfileCategoryColor(event.category));
+            if (ImGui::IsMouseHoveringRect(min, max))
+            {
+                ImGui::SetTooltip("%s: %.3f ms", event.name,
+                                  static_cast<double>(event.end_ns - event.start_ns) / 1.0e6);
+            }
+        }
+        ImGui::Dummy(ImVec2(width, kTimelineHeight));
+
+        ImGui::End();
+    }
+}
+#endif
 
 res::DebugSystems::DebugSystems(flecs::world& world)
 {
@@ -23,32 +379,54 @@ res::DebugSystems::DebugSystems(flecs::world& world)
     assert(on_render_2d_phase != 0 && "OnRender2DPhase not found");
     assert(on_pre_render_phase != 0 && "OnPreRenderPhase not found");
 
+    world.add<EntityInspectorComponent>();
+
+    // Cached once here, the overlay never looks entities up by name
+    auto player_query = world.query_builder<const MatrixComponent, const MovementInputComponent>()
+                             .with<PlayerComponent>()
+                             .cached()
+                             .build();
+    std::vector<InspectorFilter> inspector_filters{
+        {"All", world.query_builder<>().with(flecs::Any).cached().build()},
+        MakeInspectorFilter<MatrixComponent>(world, "Transform"),
+        MakeInspectorFilter<RenderableComponent>(world, "Renderable"),
+        MakeInspectorFilter<PhysicsBodyIdComponent>(world, "Physics Body"),
+        MakeInspectorFilter<CharacterControllerComponent>(world, "Character"),
+        MakeInspectorFilter<PlayerComponent>(world, "Player"),
+        MakeInspectorFilter<TextElementComponent>(world, "UI Text")
+    };
+
     world.system("Render ImGui")
          .kind(on_render_2d_phase)
-         .run([&world](flecs::iter it)
+         .run([&world, player_query, inspector_filters](flecs::iter it)
          {
              rlImGuiBegin();
 
-             const auto character = world.lookup("Character");
-             if (character != 0 && character.is_alive())
+             bool found_player = false;
+             player_query.each([&found_player](const MatrixComponent& matrix_component,
+                                               const MovementInputComponent& movement_input)
              {
-                 if (const auto matrix_component = character.try_get<MatrixComponent>())
+                 if (found_player)
                  {
-                     const auto [x, y, z] = GetPositionFromMatrix(matrix_component->matrix);
-                     const auto input = character.get<MovementInputComponent>().input;
-                     ImGui::Text("Player Position: %f,%f,%f", x, y, z);
-                     ImGui::Text("Movement Input: %f,%f", input.x, input.y);
+                     return;
                  }
-                 else
-                 {
-                     ImGui::Text("Character has no Matrix Component");
-                 }
-             }
-             else
+                 found_player = true;
+                 const auto [x, y, z] = GetPositionFromMatrix(matrix_component.matrix);
+                 ImGui::Text("Player Position: %f,%f,%f", x, y, z);
+                 ImGui::Text("Movement Input: %f,%f", movement_input.input.x, movement_input.input.y);
+             });
+             if (!found_player)
              {
-                 ImGui::Text("Character not found");
+                 ImGui::Text("Player not found");
              }
 
+             DrawEntityInspectorWindow(world, inspector_filters, world.get_mut<EntityInspectorComponent>());
+
+             DrawMemoryWindow();
+#ifdef RES_PROFILER_ENABLED
+             DrawProfilerWindow();
+#endif
+
              rlImGuiEnd();
          });
 }
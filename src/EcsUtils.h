@@ -0,0 +1,18 @@
+#pragma once
+
+#include <flecs.h>
+
+namespace res
+{
+    // Changes the flecs OS API on top of whatever hooks were installed before. ecs_os_set_api only applies the first
+    // API it is given, so every hook installer has to go through here and write ecs_os_api in place
+    template <typename Modify>
+    void UpdateEcsOsApi(Modify&& modify)
+    {
+        ecs_os_set_api_defaults();
+        ecs_os_api_t os_api = ecs_os_api;
+        modify(os_api);
+        ecs_os_set_api(&os_api);
+        ecs_os_api = os_api;
+    }
+}
@@ -0,0 +1,129 @@
+#include "FileUtils.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <spdlog/spdlog.h>
+
+
+res::MappedFile::MappedFile(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return;
+    }
+
+    const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        spdlog::error("Failed to map file {}", path.string());
+        return;
+    }
+
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        spdlog::error("Failed to map file {}", path.string());
+        return;
+    }
+
+    file_handle_ = file;
+    mapping_handle_ = mapping;
+    data_ = static_cast<const std::byte*>(view);
+    size_ = static_cast<std::size_t>(file_size.QuadPart);
+#else
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return;
+    }
+
+    struct stat file_stat{};
+    if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        close(file);
+        return;
+    }
+
+    const auto size = static_cast<std::size_t>(file_stat.st_size);
+    void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(file);
+    if (view == MAP_FAILED)
+    {
+        spdlog::error("Failed to map file {}", path.string());
+        return;
+    }
+
+    data_ = static_cast<const std::byte*>(view);
+    size_ = size;
+#endif
+}
+
+res::MappedFile::~MappedFile()
+{
+    Close();
+}
+
+res::MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+res::MappedFile& res::MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+#ifdef _WIN32
+        file_handle_ = std::exchange(other.file_handle_, nullptr);
+        mapping_handle_ = std::exchange(other.mapping_handle_, nullptr);
+#endif
+    }
+    return *this;
+}
+
+void res::MappedFile::Close()
+{
+    if (data_ == nullptr)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_handle_);
+    CloseHandle(file_handle_);
+    file_handle_ = nullptr;
+    mapping_handle_ = nullptr;
+#else
+    munmap(const_cast<std::byte*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
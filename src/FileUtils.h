@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace res
+{
+    // Read-only memory mapping of a whole file. The mapping is released when the object is destroyed
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::filesystem::path& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        [[nodiscard]] bool IsOpen() const { return data_ != nullptr; }
+        [[nodiscard]] const std::byte* GetData() const { return data_; }
+        [[nodiscard]] std::size_t GetSize() const { return size_; }
+
+    private:
+        void Close();
+
+        const std::byte* data_{nullptr};
+        std::size_t size_{0};
+#ifdef _WIN32
+        void* file_handle_{nullptr};
+        void* mapping_handle_{nullptr};
+#endif
+    };
+}
@@ -0,0 +1,160 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "MemoryTracking.h"
+
+
+namespace
+{
+    constexpr std::size_t kDefaultBlockSize = 256 * 1024;
+
+    struct ArenaRegistry
+    {
+        std::mutex mutex;
+        std::vector<res::FrameArena*> arenas;
+        res::FrameArenaStats stats{};
+    };
+
+    ArenaRegistry& GetRegistry()
+    {
+        static ArenaRegistry registry;
+        return registry;
+    }
+
+    // Registers the arena of a thread for resets and takes it out again when the thread ends
+    struct ThreadArena
+    {
+        ThreadArena()
+        {
+            ArenaRegistry& registry = GetRegistry();
+            std::lock_guard lock{registry.mutex};
+            registry.arenas.push_back(&arena);
+        }
+
+        ~ThreadArena()
+        {
+            ArenaRegistry& registry = GetRegistry();
+            std::lock_guard lock{registry.mutex};
+            registry.arenas.erase(std::remove(registry.arenas.begin(), registry.arenas.end(), &arena),
+                                  registry.arenas.end());
+        }
+
+        res::FrameArena arena{kDefaultBlockSize};
+    };
+}
+
+res::FrameArena::FrameArena(const std::size_t block_size):
+    block_size_{std::max<std::size_t>(block_size, 1024)}
+{
+}
+
+res::FrameArena::~FrameArena()
+{
+    for (const Block& block : blocks_)
+    {
+        TaggedFree(block.data);
+    }
+}
+
+void* res::FrameArena::Allocate(const std::size_t size, const std::size_t alignment)
+{
+    const auto align = [alignment](unsigned char* pointer)
+    {
+        const auto address = reinterpret_cast<std::uintptr_t>(pointer);
+        return reinterpret_cast<unsigned char*>((address + alignment - 1) & ~(alignment - 1));
+    };
+
+    unsigned char* block = cursor_ != nullptr ? align(cursor_) : nullptr;
+    if (block == nullptr || block > end_ || static_cast<std::size_t>(end_ - block) < size)
+    {
+        AddBlock(std::max(block_size_, size + alignment));
+        if (cursor_ == nullptr)
+        {
+            return nullptr;
+        }
+        block = align(cursor_);
+    }
+
+    used_bytes_ += static_cast<std::size_t>(block + size - cursor_);
+    high_water_mark_ = std::max(high_water_mark_, used_bytes_);
+    cursor_ = block + size;
+    last_allocation_ = block;
+    return block;
+}
+
+void res::FrameArena::Free(void* block, const std::size_t size)
+{
+    if (block == nullptr || block != last_allocation_ || static_cast<unsigned char*>(block) + size != cursor_)
+    {
+        return;
+    }
+    cursor_ = last_allocation_;
+    used_bytes_ -= size;
+    last_allocation_ = nullptr;
+}
+
+void res::FrameArena::Reset()
+{
+    // Swap a chain of blocks for one that fits the whole frame
+    if (blocks_.size() > 1)
+    {
+        for (const Block& block : blocks_)
+        {
+            TaggedFree(block.data);
+        }
+        blocks_.clear();
+        capacity_ = 0;
+        block_size_ = std::max(block_size_, high_water_mark_);
+        AddBlock(block_size_);
+    }
+
+    cursor_ = blocks_.empty() ? nullptr : blocks_.front().data;
+    end_ = blocks_.empty() ? nullptr : blocks_.front().data + blocks_.front().size;
+    last_allocation_ = nullptr;
+    used_bytes_ = 0;
+}
+
+void res::FrameArena::AddBlock(const std::size_t size)
+{
+    auto* data = static_cast<unsigned char*>(TaggedAllocate(size, MemoryTag::kEngine));
+    if (data == nullptr)
+    {
+        cursor_ = nullptr;
+        end_ = nullptr;
+        return;
+    }
+    blocks_.push_back({data, size});
+    capacity_ += size;
+    cursor_ = data;
+    end_ = data + size;
+}
+
+res::FrameArena& res::GetFrameArena()
+{
+    thread_local ThreadArena thread_arena;
+    return thread_arena.arena;
+}
+
+void res::ResetFrameArenas()
+{
+    ArenaRegistry& registry = GetRegistry();
+    std::lock_guard lock{registry.mutex};
+    FrameArenaStats stats{};
+    for (FrameArena* arena : registry.arenas)
+    {
+        stats.used_bytes_last_frame += arena->GetUsedBytes();
+        stats.high_water_mark += arena->GetHighWaterMark();
+        arena->Reset();
+        stats.capacity += arena->GetCapacity();
+    }
+    registry.stats = stats;
+}
+
+res::FrameArenaStats res::GetFrameArenaStats()
+{
+    ArenaRegistry& registry = GetRegistry();
+    std::lock_guard lock{registry.mutex};
+    return registry.stats;
+}
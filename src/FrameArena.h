@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace res
+{
+    struct FrameArenaStats
+    {
+        // Summed over every thread
+        std::size_t used_bytes_last_frame{0};
+        std::size_t high_water_mark{0};
+        std::size_t capacity{0};
+    };
+
+    // Linear allocator for data that lives until the end of the frame. Allocating bumps a pointer, nothing is freed
+    // on its own and Reset drops everything at once. When a frame needs more than the first block, the arena grows
+    // by chaining blocks and replaces them with a single block of the combined size on the next reset, so the heap
+    // is left alone once the arena has seen the largest frame
+    class FrameArena
+    {
+    public:
+        explicit FrameArena(std::size_t block_size);
+        ~FrameArena();
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        [[nodiscard]] void* Allocate(std::size_t size, std::size_t alignment);
+        // Only gives the memory back when block was the last allocation, e.g. a temporary freed right away
+        void Free(void* block, std::size_t size);
+        void Reset();
+
+        [[nodiscard]] std::size_t GetUsedBytes() const { return used_bytes_; }
+        [[nodiscard]] std::size_t GetHighWaterMark() const { return high_water_mark_; }
+        [[nodiscard]] std::size_t GetCapacity() const { return capacity_; }
+
+    private:
+        struct Block
+        {
+            unsigned char* data{nullptr};
+            std::size_t size{0};
+        };
+
+        void AddBlock(std::size_t size);
+
+        std::vector<Block> blocks_;
+        std::size_t block_size_;
+        unsigned char* cursor_{nullptr};
+        unsigned char* end_{nullptr};
+        unsigned char* last_allocation_{nullptr};
+        std::size_t used_bytes_{0};
+        std::size_t high_water_mark_{0};
+        std::size_t capacity_{0};
+    };
+
+    // The arena of the calling thread, created on first use
+    [[nodiscard]] FrameArena& GetFrameArena();
+    // Resets the arena of every thread. Only call while no other thread allocates from its arena, the
+    // "Reset Frame Arenas" system runs it in the post render phase
+    void ResetFrameArenas();
+    // Totals of the frame before the last reset
+    [[nodiscard]] FrameArenaStats GetFrameArenaStats();
+
+    // STL adapter on the calling thread's arena. Containers using it must not outlive the frame, which also rules out
+    // anything handed to jobs that may still run when the frame ends
+    template <typename T>
+    class FrameAllocator
+    {
+    public:
+        using value_type = T;
+
+        FrameAllocator() noexcept = default;
+
+        template <typename U>
+        FrameAllocator(const FrameAllocator<U>&) noexcept
+        {
+        }
+
+        [[nodiscard]] T* allocate(const std::size_t count)
+        {
+            void* block = GetFrameArena().Allocate(count * sizeof(T), alignof(T));
+            if (block == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(block);
+        }
+
+        void deallocate(T* block, const std::size_t count) noexcept
+        {
+            GetFrameArena().Free(block, count * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const FrameAllocator<U>&) const noexcept
+        {
+            return true;
+        }
+    };
+
+    template <typename T>
+    using FrameVector = std::vector<T, FrameAllocator<T>>;
+    using FrameString = std::basic_string<char, std::char_traits<char>, FrameAllocator<char>>;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace res
+{
+    static constexpr std::uint64_t kDefaultHashSeed = 0x9E3779B97F4A7C15ull;
+
+    // MurmurHash64A, processes the data eight bytes at a time. Pass a previous result as seed to hash several
+    // buffers into a single value
+    [[nodiscard]] inline std::uint64_t HashBytes(const void* data, const std::size_t size,
+                                                 const std::uint64_t seed = kDefaultHashSeed)
+    {
+        constexpr std::uint64_t kMultiplier = 0xC6A4A7935BD1E995ull;
+        constexpr int kShift = 47;
+
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        std::uint64_t hash = seed ^ (size * kMultiplier);
+
+        const std::size_t word_count = size / sizeof(std::uint64_t);
+        for (std::size_t i = 0; i < word_count; ++i)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, bytes + i * sizeof(std::uint64_t), sizeof(word));
+
+            word *= kMultiplier;
+            word ^= word >> kShift;
+            word *= kMultiplier;
+
+            hash ^= word;
+            hash *= kMultiplier;
+        }
+
+        const unsigned char* tail = bytes + word_count * sizeof(std::uint64_t);
+        const std::size_t tail_size = size & (sizeof(std::uint64_t) - 1);
+        if (tail_size > 0)
+        {
+            std::uint64_t word = 0;
+            std::memcpy(&word, tail, tail_size);
+            hash ^= word;
+            hash *= kMultiplier;
+        }
+
+        hash ^= hash >> kShift;
+        hash *= kMultiplier;
+        hash ^= hash >> kShift;
+        return hash;
+    }
+
+    template <typename T>
+    [[nodiscard]] std::uint64_t HashValue(const T& value, const std::uint64_t seed = kDefaultHashSeed)
+    {
+        return HashBytes(&value, sizeof(T), seed);
+    }
+}
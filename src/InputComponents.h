@@ -1,11 +1,94 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 #include <raylib.h>
 
+#include "InputSource.h"
+
 namespace res
 {
+    class InputRecorder;
+    class InputReplay;
+
     struct MovementInputComponent
     {
         Vector2 input;
     };
+
+    // Device state every input system reads, raylib's keyboard unless replaced
+    struct InputSourceComponent
+    {
+        std::shared_ptr<InputSource> source{std::make_shared<RaylibInputSource>()};
+    };
+
+    // Recordings store actions rather than keys, they only replay with the same list of actions
+    enum class InputAction : std::uint8_t
+    {
+        kMoveForward,
+        kMoveBackward,
+        kMoveLeft,
+        kMoveRight,
+        kCount
+    };
+
+    static constexpr std::size_t kInputActionCount = static_cast<std::size_t>(InputAction::kCount);
+    static_assert(kInputActionCount <= 32, "Actions are stored in a 32 bit mask");
+
+    [[nodiscard]] constexpr std::uint32_t GetInputActionBit(const InputAction action)
+    {
+        return 1u << static_cast<std::uint32_t>(action);
+    }
+
+    struct InputBinding
+    {
+        InputAction action{InputAction::kMoveForward};
+        int key{KEY_NULL};
+    };
+
+    // Keys triggering each action, any number of keys may share an action
+    struct InputActionMapComponent
+    {
+        std::vector<InputBinding> bindings{
+            {InputAction::kMoveForward, KEY_W},
+            {InputAction::kMoveBackward, KEY_S},
+            {InputAction::kMoveLeft, KEY_A},
+            {InputAction::kMoveRight, KEY_D}
+        };
+    };
+
+    // Actions sampled once at the start of the tick, systems read input from here instead of the devices
+    struct InputFrameComponent
+    {
+        std::uint32_t frame_index{0};
+        std::uint32_t down{0};
+        // Changes since the previous frame
+        std::uint32_t pressed{0};
+        std::uint32_t released{0};
+
+        [[nodiscard]] bool IsDown(const InputAction action) const { return (down & GetInputActionBit(action)) != 0; }
+        [[nodiscard]] bool WasPressed(const InputAction action) const
+        {
+            return (pressed & GetInputActionBit(action)) != 0;
+        }
+        [[nodiscard]] bool WasReleased(const InputAction action) const
+        {
+            return (released & GetInputActionBit(action)) != 0;
+        }
+    };
+
+    // Every sampled frame is appended to the recorder while it is set
+    struct InputRecorderComponent
+    {
+        std::shared_ptr<InputRecorder> recorder;
+    };
+
+    // Replaces the devices while set, the actions stay released once the replay is finished
+    struct InputReplayComponent
+    {
+        std::shared_ptr<InputReplay> replay;
+    };
 }
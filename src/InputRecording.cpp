@@ -0,0 +1,97 @@
+#include "InputRecording.h"
+
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+#include "FileUtils.h"
+#include "InputComponents.h"
+
+
+namespace
+{
+    constexpr std::uint32_t kInputFileMagic = 0x504E4952; // "RINP"
+    constexpr std::uint32_t kInputFileVersion = 1;
+
+    struct InputFileHeader
+    {
+        std::uint32_t magic{kInputFileMagic};
+        std::uint32_t version{kInputFileVersion};
+        // Recordings with a different action list can not be mapped back onto the actions
+        std::uint32_t action_count{static_cast<std::uint32_t>(res::kInputActionCount)};
+        std::uint32_t reserved{0};
+    };
+
+    static_assert(sizeof(res::InputRecordFrame) == 8);
+}
+
+res::InputRecorder::InputRecorder(const std::filesystem::path& path):
+    file_{path, std::ios::binary | std::ios::trunc}
+{
+    if (!file_)
+    {
+        spdlog::error("Failed to open input recording {} for writing", path.string());
+        return;
+    }
+
+    const InputFileHeader header{};
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void res::InputRecorder::Record(const InputRecordFrame& frame)
+{
+    if (!IsOpen())
+    {
+        return;
+    }
+    file_.write(reinterpret_cast<const char*>(&frame), sizeof(frame));
+    ++frame_count_;
+}
+
+res::InputReplay::InputReplay(const std::filesystem::path& path)
+{
+    const MappedFile file{path};
+    if (!file.IsOpen() || file.GetSize() < sizeof(InputFileHeader))
+    {
+        spdlog::error("Failed to read input recording {}", path.string());
+        return;
+    }
+
+    InputFileHeader header{};
+    std::memcpy(&header, file.GetData(), sizeof(header));
+    if (header.magic != kInputFileMagic || header.version != kInputFileVersion ||
+        header.action_count != kInputActionCount)
+    {
+        spdlog::error("Input recording {} is not compatible with this build", path.string());
+        return;
+    }
+
+    const std::size_t frame_count = (file.GetSize() - sizeof(header)) / sizeof(InputRecordFrame);
+    frames_.resize(frame_count);
+    if (frame_count > 0)
+    {
+        std::memcpy(frames_.data(), file.GetData() + sizeof(header), frame_count * sizeof(InputRecordFrame));
+    }
+    loaded_ = true;
+}
+
+std::vector<float> res::InputReplay::GetDeltaTimes() const
+{
+    std::vector<float> delta_times;
+    delta_times.reserve(frames_.size());
+    for (const InputRecordFrame& frame : frames_)
+    {
+        delta_times.push_back(frame.delta_time);
+    }
+    return delta_times;
+}
+
+bool res::InputReplay::Next(InputRecordFrame& frame)
+{
+    if (IsFinished())
+    {
+        return false;
+    }
+    frame = frames_[next_frame_++];
+    return true;
+}
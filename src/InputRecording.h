@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace res
+{
+    // One frame of a recording, the actions are stored as the bitmask of InputFrameComponent::down
+    struct InputRecordFrame
+    {
+        float delta_time{0.0f};
+        std::uint32_t actions_down{0};
+    };
+
+    // Appends sampled frames to a binary file while the session runs, the file is closed with the recorder
+    class InputRecorder
+    {
+    public:
+        explicit InputRecorder(const std::filesystem::path& path);
+
+        [[nodiscard]] bool IsOpen() const { return file_.is_open() && file_.good(); }
+        [[nodiscard]] std::uint32_t GetFrameCount() const { return frame_count_; }
+
+        void Record(const InputRecordFrame& frame);
+
+    private:
+        std::ofstream file_;
+        std::uint32_t frame_count_{0};
+    };
+
+    // Recording loaded in full and handed out one frame at a time. Replaying the recorded frame times as well, e.g.
+    // through a ScriptedTimeSource, repeats the session exactly
+    class InputReplay
+    {
+    public:
+        explicit InputReplay(const std::filesystem::path& path);
+
+        [[nodiscard]] bool IsLoaded() const { return loaded_; }
+        [[nodiscard]] bool IsFinished() const { return next_frame_ >= frames_.size(); }
+        [[nodiscard]] const std::vector<InputRecordFrame>& GetFrames() const { return frames_; }
+        [[nodiscard]] std::vector<float> GetDeltaTimes() const;
+
+        // Returns false once every frame was played
+        bool Next(InputRecordFrame& frame);
+
+    private:
+        std::vector<InputRecordFrame> frames_;
+        std::size_t next_frame_{0};
+        bool loaded_{false};
+    };
+}
@@ -0,0 +1,24 @@
+#include "InputSource.h"
+
+bool res::RaylibInputSource::IsKeyDown(const int key) const
+{
+    return ::IsKeyDown(key);
+}
+
+bool res::ScriptedInputSource::IsKeyDown(const int key) const
+{
+    return key >= 0 && key < kMaxKeys && keys_down_[key];
+}
+
+void res::ScriptedInputSource::SetKeyDown(const int key, const bool down)
+{
+    if (key >= 0 && key < kMaxKeys)
+    {
+        keys_down_[key] = down;
+    }
+}
+
+void res::ScriptedInputSource::ReleaseAllKeys()
+{
+    keys_down_.fill(false);
+}
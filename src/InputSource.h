@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+
+#include <raylib.h>
+
+namespace res
+{
+    // Where input systems read device state from, so the simulation can run without a window
+    class InputSource
+    {
+    public:
+        virtual ~InputSource() = default;
+
+        [[nodiscard]] virtual bool IsKeyDown(int key) const = 0;
+    };
+
+    // Reads the keyboard through raylib, needs the window
+    class RaylibInputSource final : public InputSource
+    {
+    public:
+        [[nodiscard]] bool IsKeyDown(int key) const override;
+    };
+
+    // Keys are pressed and released by code, for headless runs and automated tests
+    class ScriptedInputSource final : public InputSource
+    {
+    public:
+        [[nodiscard]] bool IsKeyDown(int key) const override;
+
+        void SetKeyDown(int key, bool down);
+        void ReleaseAllKeys();
+
+    private:
+        // Same key range as raylib's MAX_KEYBOARD_KEYS
+        static constexpr int kMaxKeys = 512;
+
+        std::array<bool, kMaxKeys> keys_down_{};
+    };
+}
@@ -2,6 +2,7 @@
 
 #include "CommonComponents.h"
 #include "InputComponents.h"
+#include "InputRecording.h"
 #include "Phases.h"
 
 #include <cassert>
@@ -18,15 +19,66 @@ res::InputSystems::InputSystems(flecs::world& world)
 
     assert(on_tick_phase != 0 && "OnTickPhase not found");
 
-    world.system<MovementInputComponent, const PlayerComponent>("Populate Player Movement Input")
+    world.add<InputSourceComponent>();
+    world.add<InputActionMapComponent>();
+    world.add<InputFrameComponent>();
+
+    // Declared first so it runs before every system reading input
+    world.system<const InputSourceComponent, const InputActionMapComponent, InputFrameComponent>(
+             "Sample Input Actions")
+         .term_at(0).singleton()
+         .term_at(1).singleton()
+         .term_at(2).singleton()
+         .kind(on_tick_phase)
+         .each([&world](flecs::iter& it, size_t, const InputSourceComponent& input_source,
+                        const InputActionMapComponent& action_map, InputFrameComponent& input_frame)
+         {
+             InputRecordFrame frame{it.delta_time(), 0};
+             const auto* replay = world.try_get<InputReplayComponent>();
+             if (replay != nullptr && replay->replay != nullptr)
+             {
+                 InputRecordFrame replayed_frame{};
+                 if (replay->replay->Next(replayed_frame))
+                 {
+                     frame.actions_down = replayed_frame.actions_down;
+                 }
+             }
+             else
+             {
+                 const InputSource& source = *input_source.source;
+                 for (const InputBinding& binding : action_map.bindings)
+                 {
+                     if (source.IsKeyDown(binding.key))
+                     {
+                         frame.actions_down |= GetInputActionBit(binding.action);
+                     }
+                 }
+             }
+
+             input_frame.pressed = frame.actions_down & ~input_frame.down;
+             input_frame.released = input_frame.down & ~frame.actions_down;
+             input_frame.down = frame.actions_down;
+             ++input_frame.frame_index;
+
+             if (const auto* recorder = world.try_get<InputRecorderComponent>();
+                 recorder != nullptr && recorder->recorder != nullptr)
+             {
+                 recorder->recorder->Record(frame);
+             }
+         });
+
+    world.system<const InputFrameComponent, MovementInputComponent, const PlayerComponent>(
+             "Populate Player Movement Input")
+         .term_at(0).singleton()
          .kind(on_tick_phase)
-         .each([](MovementInputComponent& movement_input, const PlayerComponent& player)
+         .each([](const InputFrameComponent& input_frame, MovementInputComponent& movement_input,
+                  const PlayerComponent& player)
          {
-             movement_input.input.x = static_cast<float>(IsKeyDown(KEY_W)) - static_cast<float>(
-                 IsKeyDown(KEY_S));
+             movement_input.input.x = static_cast<float>(input_frame.IsDown(InputAction::kMoveForward)) -
+                 static_cast<float>(input_frame.IsDown(InputAction::kMoveBackward));
 
-             movement_input.input.y = static_cast<float>(IsKeyDown(KEY_D)) - static_cast<float>(
-                 IsKeyDown(KEY_A));
+             movement_input.input.y = static_cast<float>(input_frame.IsDown(InputAction::kMoveRight)) -
+                 static_cast<float>(input_frame.IsDown(InputAction::kMoveLeft));
 
              movement_input.input = Vector2Normalize(movement_input.input);
          });
@@ -0,0 +1,121 @@
+#include "InstancedRendering.h"
+
+#include <cmath>
+
+#include <raylib.h>
+
+namespace {
+constexpr const char *kInstancingVertexShader = R"(#version 330
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+in vec4 vertexColor;
+in mat4 instanceTransform;
+
+uniform mat4 mvp;
+
+out vec2 fragTexCoord;
+out vec4 fragColor;
+
+void main()
+{
+    fragTexCoord = vertexTexCoord;
+    fragColor = vertexColor;
+    gl_Position = mvp*instanceTransform*vec4(vertexPosition, 1.0);
+}
+)";
+
+constexpr const char *kInstancingFragmentShader = R"(#version 330
+in vec2 fragTexCoord;
+in vec4 fragColor;
+
+uniform sampler2D texture0;
+uniform vec4 colDiffuse;
+
+out vec4 finalColor;
+
+void main()
+{
+    finalColor = texture(texture0, fragTexCoord)*colDiffuse*fragColor;
+}
+)";
+} // namespace
+
+Mesh res::GenMeshCapsule(const float radius, const float height,
+                         const int rings, const int slices) {
+  // Each hemisphere has rings + 1 rows of vertices, the two equator rows form
+  // the cylinder between them
+  const int row_count = 2 * (rings + 1);
+  const int column_count = slices + 1;
+
+  Mesh mesh{};
+  mesh.vertexCount = row_count * column_count;
+  mesh.triangleCount = 2 * (row_count - 1) * slices;
+  mesh.vertices = static_cast<float *>(
+      MemAlloc(mesh.vertexCount * 3 * sizeof(float)));
+  mesh.normals = static_cast<float *>(
+      MemAlloc(mesh.vertexCount * 3 * sizeof(float)));
+  mesh.texcoords = static_cast<float *>(
+      MemAlloc(mesh.vertexCount * 2 * sizeof(float)));
+  mesh.indices = static_cast<unsigned short *>(
+      MemAlloc(mesh.triangleCount * 3 * sizeof(unsigned short)));
+
+  int vertex = 0;
+  for (int row = 0; row < row_count; ++row) {
+    const bool top = row <= rings;
+    const float ring_fraction =
+        top ? 1.0f - static_cast<float>(row) / static_cast<float>(rings)
+            : -static_cast<float>(row - rings - 1) / static_cast<float>(rings);
+    const float latitude = ring_fraction * PI * 0.5f;
+    const float center_y = top ? height * 0.5f : -height * 0.5f;
+
+    for (int column = 0; column < column_count; ++column) {
+      const float longitude = 2.0f * PI * static_cast<float>(column) /
+                              static_cast<float>(slices);
+      const float normal_x = std::cos(latitude) * std::sin(longitude);
+      const float normal_y = std::sin(latitude);
+      const float normal_z = std::cos(latitude) * std::cos(longitude);
+
+      mesh.vertices[vertex * 3 + 0] = normal_x * radius;
+      mesh.vertices[vertex * 3 + 1] = normal_y * radius + center_y;
+      mesh.vertices[vertex * 3 + 2] = normal_z * radius;
+      mesh.normals[vertex * 3 + 0] = normal_x;
+      mesh.normals[vertex * 3 + 1] = normal_y;
+      mesh.normals[vertex * 3 + 2] = normal_z;
+      mesh.texcoords[vertex * 2 + 0] =
+          static_cast<float>(column) / static_cast<float>(slices);
+      mesh.texcoords[vertex * 2 + 1] =
+          static_cast<float>(row) / static_cast<float>(row_count - 1);
+      ++vertex;
+    }
+  }
+
+  int index = 0;
+  for (int row = 0; row < row_count - 1; ++row) {
+    for (int column = 0; column < slices; ++column) {
+      const auto top_left =
+          static_cast<unsigned short>(row * column_count + column);
+      const auto top_right = static_cast<unsigned short>(top_left + 1);
+      const auto bottom_left =
+          static_cast<unsigned short>((row + 1) * column_count + column);
+      const auto bottom_right = static_cast<unsigned short>(bottom_left + 1);
+      mesh.indices[index++] = top_left;
+      mesh.indices[index++] = bottom_left;
+      mesh.indices[index++] = bottom_right;
+      mesh.indices[index++] = top_left;
+      mesh.indices[index++] = bottom_right;
+      mesh.indices[index++] = top_right;
+    }
+  }
+
+  UploadMesh(&mesh, false);
+  return mesh;
+}
+
+Shader res::LoadInstancingShader() {
+  Shader shader = LoadShaderFromMemory(kInstancingVertexShader,
+                                       kInstancingFragmentShader);
+  shader.locs[SHADER_LOC_MATRIX_MVP] = GetShaderLocation(shader, "mvp");
+  shader.locs[SHADER_LOC_MATRIX_MODEL] =
+      GetShaderLocationAttrib(shader, "instanceTransform");
+  return shader;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <raylib.h>
+
+namespace res {
+// Capsule along the Y axis centered on the origin, height is the distance
+// between the centers of the two hemispheres like DrawCapsule. Uploaded to the
+// GPU, so it needs a window
+[[nodiscard]] Mesh GenMeshCapsule(float radius, float height, int rings,
+                                  int slices);
+
+// Unlit shader that reads the model matrix from the instanceTransform
+// attribute, set up for DrawMeshInstanced
+[[nodiscard]] Shader LoadInstancingShader();
+} // namespace res
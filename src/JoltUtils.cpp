@@ -10,33 +10,151 @@
 #include "RenderComponents.h"
 
 
-bool res::ObjectLayerPairFilterImpl::ShouldCollide(JPH::ObjectLayer layer1, JPH::ObjectLayer layer2) const
+res::PhysicsLayerRegistry res::PhysicsLayerRegistry::CreateDefault()
 {
-    switch (layer1)
+    PhysicsLayerRegistry registry{};
+    registry.AddBroadPhaseLayer("NON_MOVING");
+    registry.AddBroadPhaseLayer("MOVING");
+    registry.AddBroadPhaseLayer("DEBRIS");
+    registry.AddBroadPhaseLayer("SENSOR");
+
+    registry.AddObjectLayer("NON_MOVING", BroadPhaseLayers::NON_MOVING);
+    registry.AddObjectLayer("MOVING", BroadPhaseLayers::MOVING);
+    registry.AddObjectLayer("CHARACTER", BroadPhaseLayers::MOVING);
+    registry.AddObjectLayer("DEBRIS", BroadPhaseLayers::DEBRIS);
+    registry.AddObjectLayer("SENSOR", BroadPhaseLayers::SENSOR);
+    registry.AddObjectLayer("PROJECTILE", BroadPhaseLayers::MOVING);
+
+    using namespace PhysicsObjectLayers;
+    registry.SetCollision(NON_MOVING, MOVING, true);
+    registry.SetCollision(NON_MOVING, CHARACTER, true);
+    registry.SetCollision(NON_MOVING, DEBRIS, true);
+    registry.SetCollision(NON_MOVING, PROJECTILE, true);
+
+    registry.SetCollision(MOVING, MOVING, true);
+    registry.SetCollision(MOVING, CHARACTER, true);
+    registry.SetCollision(MOVING, DEBRIS, true);
+    registry.SetCollision(MOVING, SENSOR, true);
+    registry.SetCollision(MOVING, PROJECTILE, true);
+
+    // Debris only rests on the world and gets pushed around by moving bodies, characters walk through it
+    registry.SetCollision(CHARACTER, SENSOR, true);
+    registry.SetCollision(CHARACTER, PROJECTILE, true);
+
+    return registry;
+}
+
+bool res::PhysicsLayerRegistry::AddBroadPhaseLayer(const char* name)
+{
+    if (num_broad_phase_layers_ >= BroadPhaseLayers::MAX_LAYERS)
     {
-    case PhysicsObjectLayers::NON_MOVING:
-        return layer2 == PhysicsObjectLayers::MOVING;
-    case PhysicsObjectLayers::MOVING:
-        return true;
-    default:
-        JPH_ASSERT(false);
         return false;
     }
+    broad_phase_layer_names_[num_broad_phase_layers_++] = name;
+    return true;
 }
 
-bool res::ObjectVsBroadPhaseLayerFilterImpl::ShouldCollide(JPH::ObjectLayer layer1,
-                                                           JPH::BroadPhaseLayer layer2) const
+bool res::PhysicsLayerRegistry::AddObjectLayer(const char* name, const JPH::BroadPhaseLayer broad_phase_layer)
 {
-    switch (layer1)
+    if (num_object_layers_ >= PhysicsObjectLayers::MAX_LAYERS)
     {
-    case PhysicsObjectLayers::NON_MOVING:
-        return layer2 == BroadPhaseLayers::MOVING;
-    case PhysicsObjectLayers::MOVING:
-        return true;
-    default:
-        JPH_ASSERT(false);
         return false;
     }
+    JPH_ASSERT(static_cast<JPH::BroadPhaseLayer::Type>(broad_phase_layer) < num_broad_phase_layers_);
+    object_to_broad_phase_[num_object_layers_] = broad_phase_layer;
+    object_layer_names_[num_object_layers_] = name;
+    ++num_object_layers_;
+    UpdateBroadPhaseMasks();
+    return true;
+}
+
+void res::PhysicsLayerRegistry::SetCollision(const JPH::ObjectLayer layer1, const JPH::ObjectLayer layer2,
+                                             const bool enabled)
+{
+    JPH_ASSERT(layer1 < num_object_layers_ && layer2 < num_object_layers_);
+    if (enabled)
+    {
+        object_masks_[layer1] |= 1u << layer2;
+        object_masks_[layer2] |= 1u << layer1;
+    }
+    else
+    {
+        object_masks_[layer1] &= ~(1u << layer2);
+        object_masks_[layer2] &= ~(1u << layer1);
+    }
+    UpdateBroadPhaseMasks();
+}
+
+JPH::BroadPhaseLayer res::PhysicsLayerRegistry::GetBroadPhaseLayer(const JPH::ObjectLayer layer) const
+{
+    JPH_ASSERT(layer < num_object_layers_);
+    return object_to_broad_phase_[layer];
+}
+
+const char* res::PhysicsLayerRegistry::GetObjectLayerName(const JPH::ObjectLayer layer) const
+{
+    return layer < num_object_layers_ ? object_layer_names_[layer] : "INVALID";
+}
+
+const char* res::PhysicsLayerRegistry::GetBroadPhaseLayerName(const JPH::BroadPhaseLayer layer) const
+{
+    const auto index = static_cast<JPH::BroadPhaseLayer::Type>(layer);
+    return index < num_broad_phase_layers_ ? broad_phase_layer_names_[index] : "INVALID";
+}
+
+void res::PhysicsLayerRegistry::UpdateBroadPhaseMasks()
+{
+    for (JPH::uint layer = 0; layer < num_object_layers_; ++layer)
+    {
+        std::uint32_t mask = 0;
+        for (JPH::uint other = 0; other < num_object_layers_; ++other)
+        {
+            if ((object_masks_[layer] & (1u << other)) != 0)
+            {
+                mask |= 1u << static_cast<JPH::BroadPhaseLayer::Type>(object_to_broad_phase_[other]);
+            }
+        }
+        broad_phase_masks_[layer] = mask;
+    }
+}
+
+res::TrackingTempAllocator::TrackingTempAllocator(const JPH::uint size):
+    allocator_{std::make_unique<JPH::TempAllocatorImpl>(size)}, size_{size}
+{
+}
+
+void* res::TrackingTempAllocator::Allocate(const JPH::uint size)
+{
+    void* address = allocator_->Allocate(size);
+
+    // Matches TempAllocatorImpl, which rounds every block up to the vector alignment
+    const JPH::uint usage = usage_.fetch_add(JPH::AlignUp(size, JPH_RVECTOR_ALIGNMENT)) +
+        JPH::AlignUp(size, JPH_RVECTOR_ALIGNMENT);
+    JPH::uint high_water_mark = high_water_mark_.load();
+    while (usage > high_water_mark && !high_water_mark_.compare_exchange_weak(high_water_mark, usage))
+    {
+    }
+    return address;
+}
+
+void res::TrackingTempAllocator::Free(void* address, const JPH::uint size)
+{
+    allocator_->Free(address, size);
+    usage_.fetch_sub(JPH::AlignUp(size, JPH_RVECTOR_ALIGNMENT));
+}
+
+void res::ContactCounterListener::OnContactAdded(const JPH::Body& body1, const JPH::Body& body2,
+                                                 const JPH::ContactManifold& manifold,
+                                                 JPH::ContactSettings& settings)
+{
+    contact_count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void res::ContactCounterListener::OnContactPersisted(const JPH::Body& body1, const JPH::Body& body2,
+                                                     const JPH::ContactManifold& manifold,
+                                                     JPH::ContactSettings& settings)
+{
+    contact_count_.fetch_add(1, std::memory_order_relaxed);
 }
 
 void res::PopulateJoltVertices(const float* raylib_vertices, const int vertex_count, JPH::VertexList& jolt_vertices)
@@ -83,19 +201,10 @@ void res::AssembleStaticCompoundShape(JPH::StaticCompoundShapeSettings& shape_se
 {
     for (int mesh_index = 0; mesh_index < model_component.model.meshCount; ++mesh_index)
     {
-        const auto& mesh = model_component.model.meshes[mesh_index];
-
-        JPH::VertexList jolt_vertices{};
-        PopulateJoltVertices(mesh.vertices, mesh.vertexCount, jolt_vertices);
-
-        JPH::IndexedTriangleList jolt_triangle_list{};
-        PopulateJoltTriangles(mesh.indices, mesh.triangleCount, jolt_triangle_list);
+        const JPH::Ref<JPH::MeshShapeSettings> mesh_shape_settings =
+            CreateMeshShapeSettings(model_component.model.meshes[mesh_index]);
 
-        JPH::MeshShapeSettings mesh_shape_settings{
-            std::move(jolt_vertices), std::move(jolt_triangle_list)
-        };
-
-        JPH::ShapeSettings::ShapeResult shape_result = mesh_shape_settings.Create();
+        JPH::ShapeSettings::ShapeResult shape_result = mesh_shape_settings->Create();
         if (shape_result.HasError())
         {
             spdlog::error("Error creating shape: {}", shape_result.GetError());
@@ -105,3 +214,27 @@ void res::AssembleStaticCompoundShape(JPH::StaticCompoundShapeSettings& shape_se
                                shape_result.Get());
     }
 }
+
+JPH::Ref<JPH::MeshShapeSettings> res::CreateMeshShapeSettings(const Mesh& mesh)
+{
+    JPH::VertexList jolt_vertices{};
+    PopulateJoltVertices(mesh.vertices, mesh.vertexCount, jolt_vertices);
+
+    JPH::IndexedTriangleList jolt_triangle_list{};
+    PopulateJoltTriangles(mesh.indices, mesh.triangleCount, jolt_triangle_list);
+
+    return new JPH::MeshShapeSettings{std::move(jolt_vertices), std::move(jolt_triangle_list)};
+}
+
+Matrix res::ToRaylibMatrix(const JPH::RVec3Arg position, const JPH::QuatArg rotation)
+{
+    const JPH::Mat44 transform = JPH::Mat44::sRotationTranslation(rotation, JPH::Vec3(position));
+
+    // raylib stores matrices column-major but declares the fields row by row
+    return Matrix{
+        transform(0, 0), transform(0, 1), transform(0, 2), transform(0, 3),
+        transform(1, 0), transform(1, 1), transform(1, 2), transform(1, 3),
+        transform(2, 0), transform(2, 1), transform(2, 2), transform(2, 3),
+        transform(3, 0), transform(3, 1), transform(3, 2), transform(3, 3)
+    };
+}
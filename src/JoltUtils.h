@@ -1,16 +1,26 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
+#include <memory>
 
 #include <Jolt/Jolt.h>
+#include <Jolt/Core/Reference.h>
+#include <Jolt/Core/TempAllocator.h>
 #include <Jolt/Geometry/IndexedTriangle.h>
+#include <Jolt/Math/Quat.h>
 #include <Jolt/Physics/Collision/BroadPhase/BroadPhaseLayer.h>
+#include <Jolt/Physics/Collision/ContactListener.h>
 #include <Jolt/Physics/Collision/ObjectLayer.h>
+#include <raylib.h>
 
 namespace JPH
 {
+    class MeshShapeSettings;
     class StaticCompoundShapeSettings;
 }
 
@@ -22,16 +32,68 @@ namespace res
     {
         static constexpr JPH::ObjectLayer NON_MOVING = 0;
         static constexpr JPH::ObjectLayer MOVING = 1;
-        static constexpr JPH::ObjectLayer NUM_LAYERS = 2;
+        static constexpr JPH::ObjectLayer CHARACTER = 2;
+        static constexpr JPH::ObjectLayer DEBRIS = 3;
+        static constexpr JPH::ObjectLayer SENSOR = 4;
+        static constexpr JPH::ObjectLayer PROJECTILE = 5;
+        static constexpr JPH::ObjectLayer NUM_LAYERS = 6;
+        static constexpr JPH::ObjectLayer MAX_LAYERS = 32;
     }
 
     namespace BroadPhaseLayers
     {
         static constexpr JPH::BroadPhaseLayer NON_MOVING(0);
         static constexpr JPH::BroadPhaseLayer MOVING(1);
-        static constexpr JPH::uint NUM_LAYERS = 2;
+        static constexpr JPH::BroadPhaseLayer DEBRIS(2);
+        static constexpr JPH::BroadPhaseLayer SENSOR(3);
+        static constexpr JPH::uint NUM_LAYERS = 4;
+        static constexpr JPH::uint MAX_LAYERS = 32;
     }
 
+    // Object layers, the broadphase layer each one lives in and which layers collide, as one bitmask per layer.
+    // The physics system copies the registry when it is initialized, changes after that are not picked up
+    class PhysicsLayerRegistry
+    {
+    public:
+        // The PhysicsObjectLayers and BroadPhaseLayers above with the engine's default collision matrix
+        [[nodiscard]] static PhysicsLayerRegistry CreateDefault();
+
+        // Returns false when all MAX_LAYERS are taken. Layers are numbered in the order they are added
+        bool AddBroadPhaseLayer(const char* name);
+        bool AddObjectLayer(const char* name, JPH::BroadPhaseLayer broad_phase_layer);
+        // Collision is symmetric, enabling layer1 vs layer2 also enables layer2 vs layer1
+        void SetCollision(JPH::ObjectLayer layer1, JPH::ObjectLayer layer2, bool enabled);
+
+        [[nodiscard]] JPH::uint GetNumObjectLayers() const { return num_object_layers_; }
+        [[nodiscard]] JPH::uint GetNumBroadPhaseLayers() const { return num_broad_phase_layers_; }
+        [[nodiscard]] JPH::BroadPhaseLayer GetBroadPhaseLayer(JPH::ObjectLayer layer) const;
+        [[nodiscard]] const char* GetObjectLayerName(JPH::ObjectLayer layer) const;
+        [[nodiscard]] const char* GetBroadPhaseLayerName(JPH::BroadPhaseLayer layer) const;
+
+        [[nodiscard]] bool ShouldCollide(JPH::ObjectLayer layer1, JPH::ObjectLayer layer2) const
+        {
+            return (object_masks_[layer1] & (1u << layer2)) != 0;
+        }
+
+        [[nodiscard]] bool ShouldCollide(JPH::ObjectLayer layer1, JPH::BroadPhaseLayer layer2) const
+        {
+            return (broad_phase_masks_[layer1] & (1u << static_cast<JPH::BroadPhaseLayer::Type>(layer2))) != 0;
+        }
+
+    private:
+        void UpdateBroadPhaseMasks();
+
+        JPH::uint num_object_layers_{0};
+        JPH::uint num_broad_phase_layers_{0};
+        // Bit n of object_masks_[layer] is set when layer collides with object layer n
+        std::array<std::uint32_t, PhysicsObjectLayers::MAX_LAYERS> object_masks_{};
+        // Bit n of broad_phase_masks_[layer] is set when layer collides with anything in broadphase layer n
+        std::array<std::uint32_t, PhysicsObjectLayers::MAX_LAYERS> broad_phase_masks_{};
+        std::array<JPH::BroadPhaseLayer, PhysicsObjectLayers::MAX_LAYERS> object_to_broad_phase_{};
+        std::array<const char*, PhysicsObjectLayers::MAX_LAYERS> object_layer_names_{};
+        std::array<const char*, BroadPhaseLayers::MAX_LAYERS> broad_phase_layer_names_{};
+    };
+
     static void TraceImpl(const char* format, ...)
     {
         // Format the message
@@ -61,57 +123,105 @@ namespace res
     class ObjectLayerPairFilterImpl final : public JPH::ObjectLayerPairFilter
     {
     public:
-        [[nodiscard]] bool ShouldCollide(JPH::ObjectLayer layer1, JPH::ObjectLayer layer2) const override;
+        explicit ObjectLayerPairFilterImpl(const PhysicsLayerRegistry& registry):
+            registry_{registry}
+        {
+        }
+
+        [[nodiscard]] bool ShouldCollide(JPH::ObjectLayer layer1, JPH::ObjectLayer layer2) const override
+        {
+            return registry_.ShouldCollide(layer1, layer2);
+        }
+
+    private:
+        const PhysicsLayerRegistry& registry_;
     };
 
     class BPLayerInterfaceImpl final : public JPH::BroadPhaseLayerInterface
     {
     public:
-        BPLayerInterfaceImpl():
-            object_to_broad_phase_{}
+        explicit BPLayerInterfaceImpl(const PhysicsLayerRegistry& registry):
+            registry_{registry}
         {
-            object_to_broad_phase_[PhysicsObjectLayers::NON_MOVING] = BroadPhaseLayers::NON_MOVING;
-            object_to_broad_phase_[PhysicsObjectLayers::MOVING] = BroadPhaseLayers::MOVING;
         }
 
         [[nodiscard]] JPH::uint GetNumBroadPhaseLayers() const override
         {
-            return BroadPhaseLayers::NUM_LAYERS;
+            return registry_.GetNumBroadPhaseLayers();
         }
 
         [[nodiscard]] JPH::BroadPhaseLayer GetBroadPhaseLayer(JPH::ObjectLayer layer) const override
         {
-            JPH_ASSERT(layer < PhysicsObjectLayers::NUM_LAYERS);
-            return object_to_broad_phase_[layer];
+            return registry_.GetBroadPhaseLayer(layer);
         }
 
 #if defined(JPH_EXTERNAL_PROFILE) || defined(JPH_PROFILE_ENABLED)
         [[nodiscard]] const char* GetBroadPhaseLayerName(JPH::BroadPhaseLayer layer) const override
         {
-            switch (static_cast<JPH::BroadPhaseLayer::Type>(layer))
-            {
-            case static_cast<JPH::BroadPhaseLayer::Type>(BroadPhaseLayers::NON_MOVING): return "NON_MOVING";
-            case static_cast<JPH::BroadPhaseLayer::Type>(BroadPhaseLayers::MOVING): return "MOVING";
-            default:
-                JPH_ASSERT(false);
-                return "INVALID";
-            }
+            return registry_.GetBroadPhaseLayerName(layer);
         }
 #endif
 
     private:
-        JPH::BroadPhaseLayer object_to_broad_phase_[PhysicsObjectLayers::NUM_LAYERS];
+        const PhysicsLayerRegistry& registry_;
     };
 
     class ObjectVsBroadPhaseLayerFilterImpl : public JPH::ObjectVsBroadPhaseLayerFilter
     {
     public:
-        [[nodiscard]] bool ShouldCollide(JPH::ObjectLayer layer1, JPH::BroadPhaseLayer layer2) const override;
+        explicit ObjectVsBroadPhaseLayerFilterImpl(const PhysicsLayerRegistry& registry):
+            registry_{registry}
+        {
+        }
+
+        [[nodiscard]] bool ShouldCollide(JPH::ObjectLayer layer1, JPH::BroadPhaseLayer layer2) const override
+        {
+            return registry_.ShouldCollide(layer1, layer2);
+        }
+
+    private:
+        const PhysicsLayerRegistry& registry_;
     };
 
+    // Forwards to TempAllocatorImpl and records how much of it was ever in use at once
+    class TrackingTempAllocator final : public JPH::TempAllocator
+    {
+    public:
+        explicit TrackingTempAllocator(JPH::uint size);
+
+        void* Allocate(JPH::uint size) override;
+        void Free(void* address, JPH::uint size) override;
+
+        [[nodiscard]] JPH::uint GetSize() const { return size_; }
+        [[nodiscard]] JPH::uint GetHighWaterMark() const { return high_water_mark_.load(); }
+
+    private:
+        std::unique_ptr<JPH::TempAllocatorImpl> allocator_;
+        JPH::uint size_;
+        std::atomic<JPH::uint> usage_{0};
+        std::atomic<JPH::uint> high_water_mark_{0};
+    };
+
+    // Counts contact manifolds, one per contact constraint, created or kept alive during a physics step. Every
+    // collision step of the step counts its manifolds again
+    class ContactCounterListener final : public JPH::ContactListener
+    {
+    public:
+        void OnContactAdded(const JPH::Body& body1, const JPH::Body& body2, const JPH::ContactManifold& manifold,
+                            JPH::ContactSettings& settings) override;
+        void OnContactPersisted(const JPH::Body& body1, const JPH::Body& body2, const JPH::ContactManifold& manifold,
+                                JPH::ContactSettings& settings) override;
+
+        [[nodiscard]] JPH::uint ExchangeContactCount() { return contact_count_.exchange(0); }
+
+    private:
+        std::atomic<JPH::uint> contact_count_{0};
+    };
 
     void PopulateJoltVertices(const float* raylib_vertices, int vertex_count, JPH::VertexList& jolt_vertices);
     void PopulateJoltTriangles(const unsigned short* raylib_indices, int triangle_count,
                                JPH::IndexedTriangleList& jolt_triangles);
     void AssembleStaticCompoundShape(JPH::StaticCompoundShapeSettings& shape_settings, const ModelComponent& model_component);
+    [[nodiscard]] JPH::Ref<JPH::MeshShapeSettings> CreateMeshShapeSettings(const Mesh& mesh);
+    [[nodiscard]] Matrix ToRaylibMatrix(JPH::RVec3Arg position, JPH::QuatArg rotation);
 }
@@ -0,0 +1,347 @@
+#include "MemoryTracking.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include <flecs.h>
+#include <Jolt/Jolt.h>
+#include <spdlog/spdlog.h>
+
+#include "EcsUtils.h"
+
+
+namespace
+{
+    constexpr std::size_t kHeaderSize = 16;
+    constexpr std::size_t kPoolAlignment = 16;
+    constexpr std::array<std::size_t, 5> kSizeClasses{32, 64, 128, 256, 512};
+    constexpr std::uint8_t kHeapSizeClass = 0xFF;
+    constexpr std::size_t kChunkSize = 64 * 1024;
+
+    // Sits right in front of every block handed out
+    struct BlockHeader
+    {
+        std::uint64_t size;
+        // From the start of the underlying allocation to the block
+        std::uint32_t offset;
+        std::uint8_t tag;
+        std::uint8_t size_class;
+        std::uint16_t padding;
+    };
+
+    static_assert(sizeof(BlockHeader) == kHeaderSize);
+    static_assert(kHeaderSize % kPoolAlignment == 0);
+
+    struct alignas(64) TagCounters
+    {
+        std::atomic<std::int64_t> live_bytes{0};
+        std::atomic<std::int64_t> live_allocations{0};
+        std::atomic<std::uint64_t> total_allocations{0};
+    };
+
+    // Blocks of a single size carved from chunks. Freed blocks go on a free list and are reused first
+    class SizeClassPool
+    {
+    public:
+        void* Allocate(const std::size_t block_size, std::atomic<std::size_t>& reserved_bytes)
+        {
+            std::lock_guard lock{mutex_};
+            if (free_list_ != nullptr)
+            {
+                FreeBlock* block = free_list_;
+                free_list_ = block->next;
+                return block;
+            }
+
+            if (chunk_cursor_ == nullptr || static_cast<std::size_t>(chunk_end_ - chunk_cursor_) < block_size)
+            {
+                chunk_cursor_ = static_cast<unsigned char*>(::operator new(
+                    kChunkSize, std::align_val_t{kPoolAlignment}, std::nothrow));
+                if (chunk_cursor_ == nullptr)
+                {
+                    chunk_end_ = nullptr;
+                    return nullptr;
+                }
+                chunk_end_ = chunk_cursor_ + kChunkSize;
+                reserved_bytes.fetch_add(kChunkSize, std::memory_order_relaxed);
+            }
+
+            void* block = chunk_cursor_;
+            chunk_cursor_ += block_size;
+            return block;
+        }
+
+        void Free(void* block)
+        {
+            std::lock_guard lock{mutex_};
+            auto* free_block = static_cast<FreeBlock*>(block);
+            free_block->next = free_list_;
+            free_list_ = free_block;
+        }
+
+    private:
+        struct FreeBlock
+        {
+            FreeBlock* next;
+        };
+
+        std::mutex mutex_;
+        FreeBlock* free_list_{nullptr};
+        unsigned char* chunk_cursor_{nullptr};
+        unsigned char* chunk_end_{nullptr};
+    };
+
+    struct MemoryState
+    {
+        std::array<SizeClassPool, kSizeClasses.size()> pools;
+        std::array<TagCounters, res::kMemoryTagCount> counters;
+        std::atomic<std::size_t> reserved_pool_bytes{0};
+        std::atomic<std::uint64_t> frame_start_allocations{0};
+        std::atomic<std::uint64_t> last_frame_allocations{0};
+    };
+
+    // Never destroyed, Jolt and flecs still free blocks while static objects are torn down
+    MemoryState& GetState()
+    {
+        static auto* state = new MemoryState();
+        return *state;
+    }
+
+    BlockHeader& GetHeader(void* block)
+    {
+        return *reinterpret_cast<BlockHeader*>(static_cast<unsigned char*>(block) - kHeaderSize);
+    }
+
+    TagCounters& GetCounters(const std::uint8_t tag)
+    {
+        return GetState().counters[std::min<std::size_t>(tag, res::kMemoryTagCount - 1)];
+    }
+
+    void* JoltAllocate(const std::size_t size)
+    {
+        return res::TaggedAllocate(size, res::MemoryTag::kPhysics);
+    }
+
+    void* JoltReallocate(void* block, const std::size_t old_size, const std::size_t new_size)
+    {
+        return res::TaggedReallocate(block, new_size, res::MemoryTag::kPhysics);
+    }
+
+    void* JoltAlignedAllocate(const std::size_t size, const std::size_t alignment)
+    {
+        return res::TaggedAlignedAllocate(size, alignment, res::MemoryTag::kPhysics);
+    }
+
+    void* EcsMalloc(const ecs_size_t size)
+    {
+        return res::TaggedAllocate(static_cast<std::size_t>(size), res::MemoryTag::kEcs);
+    }
+
+    void* EcsCalloc(const ecs_size_t size)
+    {
+        void* block = res::TaggedAllocate(static_cast<std::size_t>(size), res::MemoryTag::kEcs);
+        if (block != nullptr)
+        {
+            std::memset(block, 0, static_cast<std::size_t>(size));
+        }
+        return block;
+    }
+
+    void* EcsRealloc(void* block, const ecs_size_t size)
+    {
+        return res::TaggedReallocate(block, static_cast<std::size_t>(size), res::MemoryTag::kEcs);
+    }
+}
+
+const char* res::GetMemoryTagName(const MemoryTag tag)
+{
+    switch (tag)
+    {
+    case MemoryTag::kPhysics:
+        return "Physics";
+    case MemoryTag::kEcs:
+        return "ECS";
+    case MemoryTag::kRender:
+        return "Render";
+    case MemoryTag::kEngine:
+    case MemoryTag::kCount:
+        break;
+    }
+    return "Engine";
+}
+
+void* res::TaggedAllocate(const std::size_t size, const MemoryTag tag)
+{
+    return TaggedAlignedAllocate(size, kPoolAlignment, tag);
+}
+
+void* res::TaggedAlignedAllocate(const std::size_t size, std::size_t alignment, const MemoryTag tag)
+{
+    MemoryState& state = GetState();
+    alignment = std::max(alignment, kPoolAlignment);
+
+    std::uint8_t size_class = kHeapSizeClass;
+    if (alignment == kPoolAlignment)
+    {
+        const auto it = std::lower_bound(kSizeClasses.begin(), kSizeClasses.end(), size);
+        if (it != kSizeClasses.end())
+        {
+            size_class = static_cast<std::uint8_t>(it - kSizeClasses.begin());
+        }
+    }
+
+    unsigned char* block = nullptr;
+    std::size_t offset = kHeaderSize;
+    if (size_class != kHeapSizeClass)
+    {
+        auto* chunk_block = static_cast<unsigned char*>(state.pools[size_class].Allocate(
+            kSizeClasses[size_class] + kHeaderSize, state.reserved_pool_bytes));
+        if (chunk_block == nullptr)
+        {
+            return nullptr;
+        }
+        block = chunk_block + kHeaderSize;
+    }
+    else
+    {
+        auto* allocation = static_cast<unsigned char*>(std::malloc(size + kHeaderSize + alignment - 1));
+        if (allocation == nullptr)
+        {
+            return nullptr;
+        }
+        const auto address = reinterpret_cast<std::uintptr_t>(allocation) + kHeaderSize;
+        block = reinterpret_cast<unsigned char*>((address + alignment - 1) & ~(alignment - 1));
+        offset = static_cast<std::size_t>(block - allocation);
+    }
+
+    GetHeader(block) = {size, static_cast<std::uint32_t>(offset), static_cast<std::uint8_t>(tag), size_class, 0};
+
+    TagCounters& counters = GetCounters(static_cast<std::uint8_t>(tag));
+    counters.live_bytes.fetch_add(static_cast<std::int64_t>(size), std::memory_order_relaxed);
+    counters.live_allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.total_allocations.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+void* res::TaggedReallocate(void* block, const std::size_t size, const MemoryTag tag)
+{
+    if (block == nullptr)
+    {
+        return TaggedAllocate(size, tag);
+    }
+
+    BlockHeader& header = GetHeader(block);
+    // Growing within the size class of the block keeps it where it is
+    if (header.size_class != kHeapSizeClass && size <= kSizeClasses[header.size_class])
+    {
+        GetCounters(header.tag).live_bytes.fetch_add(
+            static_cast<std::int64_t>(size) - static_cast<std::int64_t>(header.size), std::memory_order_relaxed);
+        header.size = size;
+        return block;
+    }
+
+    void* new_block = TaggedAllocate(size, static_cast<MemoryTag>(header.tag));
+    if (new_block == nullptr)
+    {
+        return nullptr;
+    }
+    std::memcpy(new_block, block, std::min<std::size_t>(size, header.size));
+    TaggedFree(block);
+    return new_block;
+}
+
+void res::TaggedFree(void* block)
+{
+    if (block == nullptr)
+    {
+        return;
+    }
+
+    const BlockHeader header = GetHeader(block);
+    TagCounters& counters = GetCounters(header.tag);
+    counters.live_bytes.fetch_sub(static_cast<std::int64_t>(header.size), std::memory_order_relaxed);
+    counters.live_allocations.fetch_sub(1, std::memory_order_relaxed);
+
+    unsigned char* allocation = static_cast<unsigned char*>(block) - header.offset;
+    if (header.size_class != kHeapSizeClass)
+    {
+        GetState().pools[header.size_class].Free(allocation);
+    }
+    else
+    {
+        std::free(allocation);
+    }
+}
+
+res::MemoryTagStats res::GetMemoryTagStats(const MemoryTag tag)
+{
+    const TagCounters& counters = GetCounters(static_cast<std::uint8_t>(tag));
+    return {
+        counters.live_bytes.load(std::memory_order_relaxed),
+        counters.live_allocations.load(std::memory_order_relaxed),
+        counters.total_allocations.load(std::memory_order_relaxed)
+    };
+}
+
+std::uint64_t res::GetTotalAllocationCount()
+{
+    std::uint64_t total = 0;
+    for (const TagCounters& counters : GetState().counters)
+    {
+        total += counters.total_allocations.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::size_t res::GetReservedPoolBytes()
+{
+    return GetState().reserved_pool_bytes.load(std::memory_order_relaxed);
+}
+
+void res::MarkAllocationFrame()
+{
+    MemoryState& state = GetState();
+    const std::uint64_t total = GetTotalAllocationCount();
+    const std::uint64_t frame_start = state.frame_start_allocations.exchange(total, std::memory_order_relaxed);
+    state.last_frame_allocations.store(total - frame_start, std::memory_order_relaxed);
+}
+
+std::uint64_t res::GetLastFrameAllocationCount()
+{
+    return GetState().last_frame_allocations.load(std::memory_order_relaxed);
+}
+
+void res::InstallJoltAllocator()
+{
+    if (JPH::Allocate == JoltAllocate)
+    {
+        return;
+    }
+    if (JPH::Allocate != nullptr)
+    {
+        // Blocks of the other allocator may be alive already, they can not be handed to ours
+        spdlog::warn("Jolt has an allocator registered already, physics allocations are not tracked");
+        return;
+    }
+
+    JPH::Allocate = JoltAllocate;
+    JPH::Reallocate = JoltReallocate;
+    JPH::Free = TaggedFree;
+    JPH::AlignedAllocate = JoltAlignedAllocate;
+    JPH::AlignedFree = TaggedFree;
+}
+
+void res::InstallEcsAllocator()
+{
+    UpdateEcsOsApi([](ecs_os_api_t& os_api)
+    {
+        os_api.malloc_ = EcsMalloc;
+        os_api.calloc_ = EcsCalloc;
+        os_api.realloc_ = EcsRealloc;
+        os_api.free_ = TaggedFree;
+    });
+}
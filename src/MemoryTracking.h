@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace res
+{
+    // Subsystem an allocation is charged to
+    enum class MemoryTag : std::uint8_t
+    {
+        kPhysics,
+        kEcs,
+        kRender,
+        kEngine,
+        kCount
+    };
+
+    static constexpr std::size_t kMemoryTagCount = static_cast<std::size_t>(MemoryTag::kCount);
+
+    [[nodiscard]] const char* GetMemoryTagName(MemoryTag tag);
+
+    struct MemoryTagStats
+    {
+        // Requested sizes, without headers or pool rounding
+        std::int64_t live_bytes{0};
+        std::int64_t live_allocations{0};
+        std::uint64_t total_allocations{0};
+    };
+
+    // Thread-safe. Blocks up to 512 bytes with the default alignment come from pools of fixed size classes, larger
+    // or more strictly aligned blocks from the system heap. Every block carries a small header with its size and
+    // tag, so it is freed without either
+    [[nodiscard]] void* TaggedAllocate(std::size_t size, MemoryTag tag);
+    [[nodiscard]] void* TaggedAlignedAllocate(std::size_t size, std::size_t alignment, MemoryTag tag);
+    // Keeps the tag of the block, tag is only used when block is null
+    [[nodiscard]] void* TaggedReallocate(void* block, std::size_t size, MemoryTag tag);
+    void TaggedFree(void* block);
+
+    [[nodiscard]] MemoryTagStats GetMemoryTagStats(MemoryTag tag);
+    [[nodiscard]] std::uint64_t GetTotalAllocationCount();
+    // Memory taken from the system for the pools, pools never give it back
+    [[nodiscard]] std::size_t GetReservedPoolBytes();
+
+    // Called once per frame, closes the allocation count of the frame that ended
+    void MarkAllocationFrame();
+    [[nodiscard]] std::uint64_t GetLastFrameAllocationCount();
+
+    // Routes JPH::Allocate and friends to the physics tag. Replaces JPH::RegisterDefaultAllocator and has to run
+    // before Jolt allocates anything, an allocator registered earlier is kept
+    void InstallJoltAllocator();
+    // Routes the flecs OS API allocation hooks to the ECS tag. Call before the first flecs world is created
+    void InstallEcsAllocator();
+
+    // STL adapter for engine containers, e.g. std::vector<T, TaggedAllocator<T, MemoryTag::kRender>>
+    template <typename T, MemoryTag Tag = MemoryTag::kEngine>
+    class TaggedAllocator
+    {
+    public:
+        using value_type = T;
+
+        template <typename U>
+        struct rebind
+        {
+            using other = TaggedAllocator<U, Tag>;
+        };
+
+        TaggedAllocator() noexcept = default;
+
+        template <typename U>
+        TaggedAllocator(const TaggedAllocator<U, Tag>&) noexcept
+        {
+        }
+
+        [[nodiscard]] T* allocate(const std::size_t count)
+        {
+            void* block = TaggedAlignedAllocate(count * sizeof(T), alignof(T), Tag);
+            if (block == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(block);
+        }
+
+        void deallocate(T* block, std::size_t) noexcept
+        {
+            TaggedFree(block);
+        }
+
+        template <typename U>
+        bool operator==(const TaggedAllocator<U, Tag>&) const noexcept
+        {
+            return true;
+        }
+    };
+}
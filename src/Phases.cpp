@@ -2,6 +2,10 @@
 
 #include <flecs.h>
 
+#include "FrameArena.h"
+#include "MemoryTracking.h"
+#include "Profiler.h"
+
 void res::CreatePhases(flecs::world& world)
 {
     auto on_begin = world.entity(kBeginPhaseName.data())
@@ -43,4 +47,43 @@ void res::CreatePhases(flecs::world& world)
     auto on_post_render = world.entity(kPostRenderPhaseName.data())
                              .add(flecs::Phase)
                              .depends_on(on_render_2d);
+
+#ifdef RES_PROFILER_ENABLED
+    // Created before any other system, so every marker is the first system of its phase. A frame runs from one tick
+    // marker to the next
+    world.system("Profile Frame")
+         .kind(on_tick)
+         .run([](flecs::iter& it)
+         {
+             Profiler::Get().NextFrame();
+         });
+
+    for (const flecs::entity phase : {on_begin, on_tick, on_post_tick, on_pre_render, on_render, on_pre_render_3d,
+                                      on_render_3d, on_post_render_3d, on_render_2d, on_post_render})
+    {
+        const char* phase_name = phase.name().c_str();
+        world.system()
+             .kind(phase)
+             .run([phase_name](flecs::iter& it)
+             {
+                 Profiler::Get().MarkPhase(phase_name);
+             });
+    }
+#endif
+
+    // Created before any module, so a frame's allocations are counted from one tick to the next
+    world.system("Count Frame Allocations")
+         .kind(on_tick)
+         .run([](flecs::iter& it)
+         {
+             MarkAllocationFrame();
+         });
+
+    // Everything is drawn by now, nothing may hold on to frame allocations past it
+    world.system("Reset Frame Arenas")
+         .kind(on_post_render)
+         .run([](flecs::iter& it)
+         {
+             ResetFrameArenas();
+         });
 }
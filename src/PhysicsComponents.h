@@ -1,25 +1,109 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "CharacterCrowd.h"
 #include "JoltUtils.h"
+#include "ShapeCache.h"
+#include "TaskScheduler.h"
 
 #include <flecs.h>
 #include <Jolt/Jolt.h>
-#include <Jolt/Core/JobSystemThreadPool.h>
 #include <Jolt/Physics/Body/BodyInterface.h>
+#include <Jolt/Physics/Body/BodyLockInterface.h>
 #include <Jolt/Physics/PhysicsSystem.h>
 
 
 namespace res
 {
+    // Read once when the physics system is initialized, set it before PhysicsHandleComponent is added
+    struct PhysicsConfigComponent
+    {
+        JPH::uint max_bodies{65536};
+        JPH::uint num_body_mutexes{0};
+        JPH::uint max_body_pairs{65536};
+        JPH::uint max_contact_constraints{10240};
+        JPH::uint temp_allocator_size{10 * 1024 * 1024};
+        // Worker count and core affinity of the scheduler physics creates when the world has no TaskSchedulerComponent
+        TaskSchedulerConfig scheduler{};
+    };
+
+    struct PhysicsTelemetryComponent
+    {
+        JPH::uint temp_allocator_size{0};
+        JPH::uint temp_allocator_high_water_mark{0};
+        JPH::uint num_bodies{0};
+        JPH::uint max_bodies{0};
+        JPH::uint num_active_bodies{0};
+        // Contact manifolds per collision step of the last step, each one takes a contact constraint
+        JPH::uint num_contacts{0};
+        JPH::uint peak_contacts{0};
+        JPH::uint max_contact_constraints{0};
+        JPH::uint max_body_pairs{0};
+        // Steps that ran out of room and dropped contacts or body pairs
+        JPH::uint contact_constraint_overflows{0};
+        JPH::uint body_pair_overflows{0};
+        JPH::uint manifold_overflows{0};
+        JPH::uint num_characters{0};
+        int worker_count{0};
+        double last_step_ms{0.0};
+        double average_step_ms{0.0};
+        double max_step_ms{0.0};
+    };
+
+    // Read once when the physics system is initialized, like PhysicsConfigComponent
+    struct PhysicsLayerRegistryComponent
+    {
+        PhysicsLayerRegistry registry{PhysicsLayerRegistry::CreateDefault()};
+    };
+
+    // Object layer of the entity's body. Bodies without one use the default layer of their kind, setting it later
+    // moves the existing body to the new layer
+    struct PhysicsLayerComponent
+    {
+        JPH::ObjectLayer layer{PhysicsObjectLayers::MOVING};
+    };
+
     struct PhysicsHandleComponent
     {
+        // The layer interface and filters below keep a reference to it
+        std::unique_ptr<PhysicsLayerRegistry> layer_registry;
         std::unique_ptr<BPLayerInterfaceImpl> broad_phase_layer_interface;
         std::unique_ptr<ObjectVsBroadPhaseLayerFilterImpl> object_vs_broad_phase_layer_filter;
         std::unique_ptr<ObjectLayerPairFilterImpl> object_vs_object_layer_filter;
+        std::unique_ptr<ContactCounterListener> contact_listener;
         std::unique_ptr<JPH::PhysicsSystem> physics_system;
-        std::unique_ptr<JPH::TempAllocatorImpl> temp_allocator;
-        std::unique_ptr<JPH::JobSystemThreadPool> job_system;
+        std::unique_ptr<TrackingTempAllocator> temp_allocator;
+        // Only set when the world has no TaskSchedulerComponent, job_system points at it then
+        std::unique_ptr<TaskScheduler> owned_job_system;
+        JPH::JobSystem* job_system{nullptr};
+        std::unique_ptr<ShapeCache> shape_cache;
+        std::unique_ptr<CharacterCrowd> character_crowd;
         JPH::BodyInterface* body_interface{nullptr};
+        // Safe from multi threaded systems as long as each body is only touched by the entity that owns it
+        const JPH::BodyInterface* body_interface_no_lock{nullptr};
+    };
+
+    // Bodies created this frame, added to the simulation in one batch before the next physics step
+    struct PhysicsBodyQueueComponent
+    {
+        JPH::BodyIDVector activated_bodies;
+        JPH::BodyIDVector inactive_bodies;
+        // Destroyed before the queue was drained, skipped by the batch instead of searched for in the queue
+        std::unordered_set<JPH::uint32> removed_bodies;
+        std::uint32_t bodies_since_optimization{0};
+        // Rebuild the broadphase once this many bodies were added since the last rebuild, zero disables it
+        std::uint32_t optimize_broad_phase_threshold{1024};
+    };
+
+    struct ShapeCacheSettingsComponent
+    {
+        // Cooked shapes are kept in memory only when empty, set a directory to reuse them across runs
+        std::string directory;
     };
 
     struct RigidbodySphereComponent
@@ -35,10 +119,39 @@ namespace res
     {
     };
 
+    // Added while the collider shape is still cooking, the body is created once it is ready
+    struct PendingMeshColliderComponent
+    {
+        std::uint64_t geometry_hash{0};
+    };
+
+    // Collider cooking progress for loading screens. Loading is done once pending_bodies drops to zero
+    struct MeshColliderLoadingComponent
+    {
+        std::uint32_t requested_meshes{0};
+        std::uint32_t cooked_meshes{0};
+        std::uint32_t pending_bodies{0};
+    };
+
+    // Characters are not bodies and never get a PhysicsBodyIdComponent
     struct CharacterControllerComponent
     {
         float character_height = 2.0f;
         float character_radius = 0.5f;
+        float movement_speed = 5.0f;
+    };
+
+    // Created for every entity with a CharacterControllerComponent. The character is not a body in the simulation,
+    // it is moved by the CharacterCrowd in the physics handle
+    struct CharacterVirtualComponent
+    {
+        JPH::Ref<JPH::CharacterVirtual> character;
+    };
+
+    // Read once when the physics system is initialized
+    struct CharacterCrowdSettingsComponent
+    {
+        CharacterCrowdSettings settings{};
     };
 
     struct GravityComponent
@@ -46,12 +159,79 @@ namespace res
         JPH::Vec3 gravity_force = JPH::Vec3(0.0f, -9.8f, 0.0f);
     };
 
+    enum class PhysicsSmoothingMode
+    {
+        kNone,
+        kInterpolate,
+        kExtrapolate
+    };
+
+    struct PhysicsStepSettingsComponent
+    {
+        bool use_fixed_step{true};
+        float step_rate{60.0f};
+        int max_steps_per_frame{4};
+        int collision_steps{1};
+        PhysicsSmoothingMode smoothing_mode{PhysicsSmoothingMode::kInterpolate};
+    };
+
+    struct PhysicsStepStateComponent
+    {
+        float accumulator{0.0f};
+        // Fraction of a fixed step left in the accumulator, used to blend between the last two steps
+        float alpha{0.0f};
+        float step_delta{0.0f};
+        int steps_this_frame{0};
+        JPH::uint64 step_count{0};
+        // Scratch list reused by the transform sync, filled from PhysicsSystem::GetActiveBodies
+        JPH::BodyIDVector active_body_ids;
+        // Entities whose bodies were active after the last step and get a smoothed transform every frame.
+        // Their PhysicsInterpolationComponent::current_step equals step_count
+        std::vector<flecs::entity_t> moving_entities;
+        std::vector<flecs::entity_t> settled_entities;
+        // Scratch list reused by the character update
+        std::vector<CharacterMove> character_moves;
+    };
+
+    // Body state at the last two physics steps, added to every entity with a PhysicsBodyIdComponent.
+    // Bodies map back to their entity through the body user data, which holds the entity id
+    struct PhysicsInterpolationComponent
+    {
+        JPH::RVec3 previous_position{JPH::RVec3::sZero()};
+        JPH::Quat previous_rotation{JPH::Quat::sIdentity()};
+        JPH::RVec3 current_position{JPH::RVec3::sZero()};
+        JPH::Quat current_rotation{JPH::Quat::sIdentity()};
+        JPH::Vec3 linear_velocity{JPH::Vec3::sZero()};
+        JPH::Vec3 angular_velocity{JPH::Vec3::sZero()};
+        JPH::uint64 previous_step{0};
+        JPH::uint64 current_step{0};
+        bool initialized{false};
+    };
+
+    // Present while the body of the entity was active after the last physics step, the entities whose transform
+    // follows the simulation every frame
+    struct PhysicsActiveComponent
+    {
+    };
+
     struct PhysicsComponents
     {
         explicit PhysicsComponents(flecs::world& world)
         {
             world.module<PhysicsComponents>();
 
+            world.component<PhysicsBodyIdComponent>()
+                 .add(flecs::With, world.component<PhysicsInterpolationComponent>());
+
+            world.add<PhysicsConfigComponent>();
+            world.add<PhysicsLayerRegistryComponent>();
+            world.add<PhysicsTelemetryComponent>();
+            world.add<ShapeCacheSettingsComponent>();
+            world.add<CharacterCrowdSettingsComponent>();
+            world.add<MeshColliderLoadingComponent>();
+            world.add<PhysicsBodyQueueComponent>();
+            world.add<PhysicsStepSettingsComponent>();
+            world.add<PhysicsStepStateComponent>();
             world.add<PhysicsHandleComponent>();
         }
     };
@@ -1,14 +1,16 @@
 #include "PhysicsSystems.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 
 #include <flecs.h>
 #include <Jolt/Jolt.h>
 #include <Jolt/Core/Factory.h>
-#include <Jolt/Core/JobSystemThreadPool.h>
 #include <Jolt/Core/TempAllocator.h>
 #include <Jolt/Physics/Body/BodyCreationSettings.h>
-#include <Jolt/Physics/Character/Character.h>
+#include <Jolt/Physics/Character/CharacterVirtual.h>
 #include <Jolt/Physics/Collision/Shape/CapsuleShape.h>
 #include <Jolt/Physics/Collision/Shape/MeshShape.h>
 #include <Jolt/Physics/Collision/Shape/RotatedTranslatedShape.h>
@@ -19,17 +21,300 @@
 #include <Jolt/RegisterTypes.h>
 #include <spdlog/spdlog.h>
 
+#include "CharacterCrowd.h"
 #include "InputComponents.h"
 #include "JoltUtils.h"
 #include "MathUtils.h"
+#include "MemoryTracking.h"
 #include "Phases.h"
 #include "PhysicsComponents.h"
 #include "RenderComponents.h"
+#include "TaskScheduler.h"
 #include "TransformComponents.h"
 
 
 using namespace JPH::literals;
 
+namespace
+{
+    [[nodiscard]] res::PhysicsInterpolationComponent* GetInterpolationForBody(const flecs::world& world,
+                                                                            const JPH::Body& body)
+    {
+        const auto entity_id = static_cast<flecs::entity_t>(body.GetUserData());
+        if (entity_id == 0)
+        {
+            return nullptr;
+        }
+        const flecs::entity entity{world.c_ptr(), entity_id};
+        if (!entity.is_alive())
+        {
+            return nullptr;
+        }
+        return entity.try_get_mut<res::PhysicsInterpolationComponent>();
+    }
+
+    // Unregistered layers would index past the collision masks of the registry, they fall back to default_layer
+    JPH::ObjectLayer GetEntityObjectLayer(const flecs::entity entity, const res::PhysicsLayerRegistry& registry,
+                                          const JPH::ObjectLayer default_layer)
+    {
+        const auto* layer_component = entity.try_get<res::PhysicsLayerComponent>();
+        if (layer_component == nullptr)
+        {
+            return default_layer;
+        }
+        if (layer_component->layer >= registry.GetNumObjectLayers())
+        {
+            spdlog::error("Object layer {} is not registered!", layer_component->layer);
+            return default_layer;
+        }
+        return layer_component->layer;
+    }
+
+    // Rates that are not positive would divide by zero, the fixed step falls back to 60 Hz for them
+    float GetStepRate(const res::PhysicsStepSettingsComponent& settings)
+    {
+        constexpr float kDefaultStepRate = 60.0f;
+        return settings.step_rate > 0.0f ? settings.step_rate : kDefaultStepRate;
+    }
+
+    // Children in the transform hierarchy only recompute once their physics driven parent moved
+    void MarkWorldTransformChanged(res::TransformStateComponent* transform_state)
+    {
+        if (transform_state != nullptr)
+        {
+            ++transform_state->world_version;
+        }
+    }
+
+    // Pose of every active body before the last step of the frame, read without taking body locks
+    void CapturePreviousBodyStates(const flecs::world& world, const JPH::PhysicsSystem& physics_system,
+                                   res::PhysicsStepStateComponent& state)
+    {
+        physics_system.GetActiveBodies(JPH::EBodyType::RigidBody, state.active_body_ids);
+        const JPH::BodyLockInterfaceNoLock& lock_interface = physics_system.GetBodyLockInterfaceNoLock();
+
+        for (const JPH::BodyID& body_id : state.active_body_ids)
+        {
+            const JPH::Body* body = lock_interface.TryGetBody(body_id);
+            if (body == nullptr)
+            {
+                continue;
+            }
+            auto* interpolation = GetInterpolationForBody(world, *body);
+            if (interpolation == nullptr)
+            {
+                continue;
+            }
+            interpolation->previous_position = body->GetPosition();
+            interpolation->previous_rotation = body->GetRotation();
+            interpolation->previous_step = state.step_count + 1;
+        }
+    }
+
+    // Pose of every active body after the last step. Entities whose body fell asleep are snapped to their final
+    // pose once and then left alone until the body wakes up again
+    void CaptureCurrentBodyStates(const flecs::world& world, const JPH::PhysicsSystem& physics_system,
+                                  res::PhysicsStepStateComponent& state)
+    {
+        physics_system.GetActiveBodies(JPH::EBodyType::RigidBody, state.active_body_ids);
+        const JPH::BodyLockInterfaceNoLock& lock_interface = physics_system.GetBodyLockInterfaceNoLock();
+
+        state.settled_entities.swap(state.moving_entities);
+        state.moving_entities.clear();
+        state.moving_entities.reserve(state.active_body_ids.size());
+
+        for (const JPH::BodyID& body_id : state.active_body_ids)
+        {
+            const JPH::Body* body = lock_interface.TryGetBody(body_id);
+            if (body == nullptr)
+            {
+                continue;
+            }
+            auto* interpolation = GetInterpolationForBody(world, *body);
+            if (interpolation == nullptr)
+            {
+                continue;
+            }
+
+            const JPH::RVec3 position = body->GetPosition();
+            const JPH::Quat rotation = body->GetRotation();
+            if (!interpolation->initialized)
+            {
+                interpolation->previous_position = position;
+                interpolation->previous_rotation = rotation;
+                interpolation->initialized = true;
+            }
+            else if (interpolation->previous_step != state.step_count)
+            {
+                // The body woke up during the last step, so the pose it slept in is the previous one
+                interpolation->previous_position = interpolation->current_position;
+                interpolation->previous_rotation = interpolation->current_rotation;
+            }
+            interpolation->current_position = position;
+            interpolation->current_rotation = rotation;
+            interpolation->linear_velocity = body->GetLinearVelocity();
+            interpolation->angular_velocity = body->GetAngularVelocity();
+            interpolation->current_step = state.step_count;
+            const flecs::entity entity{world.c_ptr(), static_cast<flecs::entity_t>(body->GetUserData())};
+            if (!entity.has<res::PhysicsActiveComponent>())
+            {
+                entity.add<res::PhysicsActiveComponent>();
+            }
+            state.moving_entities.push_back(entity.id());
+        }
+
+        for (const flecs::entity_t settled_id : state.settled_entities)
+        {
+            const flecs::entity entity{world.c_ptr(), settled_id};
+            if (!entity.is_alive())
+            {
+                continue;
+            }
+            auto* interpolation = entity.try_get_mut<res::PhysicsInterpolationComponent>();
+            auto* matrix_component = entity.try_get_mut<res::MatrixComponent>();
+            if (interpolation == nullptr || interpolation->current_step == state.step_count)
+            {
+                continue;
+            }
+            entity.remove<res::PhysicsActiveComponent>();
+            interpolation->previous_position = interpolation->current_position;
+            interpolation->previous_rotation = interpolation->current_rotation;
+            interpolation->linear_velocity = JPH::Vec3::sZero();
+            interpolation->angular_velocity = JPH::Vec3::sZero();
+            if (matrix_component != nullptr)
+            {
+                matrix_component->matrix = res::ToRaylibMatrix(interpolation->current_position,
+                                                               interpolation->current_rotation);
+                MarkWorldTransformChanged(entity.try_get_mut<res::TransformStateComponent>());
+            }
+        }
+        state.settled_entities.clear();
+    }
+
+    void QueueBodyInsertion(res::PhysicsBodyQueueComponent& queue, const JPH::BodyID body_id,
+                            const JPH::EActivation activation)
+    {
+        auto& bodies = activation == JPH::EActivation::Activate ? queue.activated_bodies : queue.inactive_bodies;
+        bodies.push_back(body_id);
+    }
+
+    // Used when a body is destroyed before the queue is drained
+    void DequeueBodyInsertion(res::PhysicsBodyQueueComponent& queue, const JPH::BodyID body_id)
+    {
+        queue.removed_bodies.insert(body_id.GetIndexAndSequenceNumber());
+    }
+
+    // Returns the number of bodies added
+    int AddBodiesInBatch(JPH::BodyInterface& body_interface, JPH::BodyIDVector& bodies,
+                         const std::unordered_set<JPH::uint32>& removed_bodies, const JPH::EActivation activation)
+    {
+        if (!removed_bodies.empty())
+        {
+            bodies.erase(std::remove_if(bodies.begin(), bodies.end(), [&removed_bodies](const JPH::BodyID body_id)
+            {
+                return removed_bodies.contains(body_id.GetIndexAndSequenceNumber());
+            }), bodies.end());
+        }
+        if (bodies.empty())
+        {
+            return 0;
+        }
+
+        const int body_count = static_cast<int>(bodies.size());
+        const JPH::BodyInterface::AddState add_state = body_interface.AddBodiesPrepare(bodies.data(), body_count);
+        body_interface.AddBodiesFinalize(bodies.data(), body_count, add_state, activation);
+        bodies.clear();
+        return body_count;
+    }
+
+    void StepPhysics(const res::PhysicsHandleComponent& handle, const float delta_time, const int collision_steps,
+                     res::PhysicsTelemetryComponent& telemetry)
+    {
+        // Exponential moving average over roughly the last second of 60 Hz steps
+        constexpr double kAverageWeight = 1.0 / 60.0;
+
+        const auto step_start = std::chrono::steady_clock::now();
+        const JPH::EPhysicsUpdateError update_error = handle.physics_system->Update(
+            delta_time, collision_steps, handle.temp_allocator.get(), handle.job_system);
+        const double step_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - step_start).count();
+
+        telemetry.last_step_ms = step_ms;
+        telemetry.max_step_ms = std::max(telemetry.max_step_ms, step_ms);
+        telemetry.average_step_ms = telemetry.average_step_ms == 0.0
+                                        ? step_ms
+                                        : telemetry.average_step_ms + (step_ms - telemetry.average_step_ms) *
+                                        kAverageWeight;
+        // The listener is called once per collision step, contact constraints only have to fit one of them
+        telemetry.num_contacts = handle.contact_listener->ExchangeContactCount() /
+                                 static_cast<JPH::uint>(std::max(collision_steps, 1));
+        telemetry.peak_contacts = std::max(telemetry.peak_contacts, telemetry.num_contacts);
+        telemetry.temp_allocator_high_water_mark = handle.temp_allocator->GetHighWaterMark();
+
+        if (update_error == JPH::EPhysicsUpdateError::None)
+        {
+            return;
+        }
+
+        const auto has_error = [update_error](const JPH::EPhysicsUpdateError error)
+        {
+            return (static_cast<JPH::uint32>(update_error) & static_cast<JPH::uint32>(error)) != 0;
+        };
+        if (has_error(JPH::EPhysicsUpdateError::ContactConstraintsFull) && telemetry.contact_constraint_overflows++ == 0)
+        {
+            spdlog::warn("Contact constraint buffer full ({}), contacts are being dropped",
+                         telemetry.max_contact_constraints);
+        }
+        if (has_error(JPH::EPhysicsUpdateError::BodyPairCacheFull) && telemetry.body_pair_overflows++ == 0)
+        {
+            spdlog::warn("Body pair buffer full ({}), contacts are being dropped", telemetry.max_body_pairs);
+        }
+        if (has_error(JPH::EPhysicsUpdateError::ManifoldCacheFull) && telemetry.manifold_overflows++ == 0)
+        {
+            spdlog::warn("Contact manifold cache full, contacts are being dropped");
+        }
+    }
+
+    void UpdateBodyTelemetry(const JPH::PhysicsSystem& physics_system, res::PhysicsTelemetryComponent& telemetry)
+    {
+        telemetry.num_bodies = physics_system.GetNumBodies();
+        telemetry.max_bodies = physics_system.GetMaxBodies();
+        telemetry.num_active_bodies = physics_system.GetNumActiveBodies(JPH::EBodyType::RigidBody);
+    }
+
+    void SmoothBodyState(const res::PhysicsInterpolationComponent& interpolation,
+                         const res::PhysicsSmoothingMode smoothing_mode, const float alpha, const float step_delta,
+                         JPH::RVec3& position, JPH::Quat& rotation)
+    {
+        switch (smoothing_mode)
+        {
+        case res::PhysicsSmoothingMode::kInterpolate:
+            position = interpolation.previous_position +
+                (interpolation.current_position - interpolation.previous_position) * alpha;
+            rotation = interpolation.previous_rotation.SLERP(interpolation.current_rotation, alpha).Normalized();
+            return;
+        case res::PhysicsSmoothingMode::kExtrapolate:
+            {
+                constexpr float kMinRotationAngle = 1.0e-6f;
+                const float extrapolation_time = alpha * step_delta;
+                position = interpolation.current_position + interpolation.linear_velocity * extrapolation_time;
+
+                const JPH::Vec3 rotation_vector = interpolation.angular_velocity * extrapolation_time;
+                const float angle = rotation_vector.Length();
+                rotation = angle > kMinRotationAngle
+                               ? (JPH::Quat::sRotation(rotation_vector / angle, angle) *
+                                   interpolation.current_rotation).Normalized()
+                               : interpolation.current_rotation;
+                return;
+            }
+        case res::PhysicsSmoothingMode::kNone:
+        default:
+            position = interpolation.current_position;
+            rotation = interpolation.current_rotation;
+        }
+    }
+}
+
 res::PhysicsSystems::PhysicsSystems(flecs::world& world)
 {
     world.module<PhysicsSystems>();
@@ -40,9 +325,9 @@ res::PhysicsSystems::PhysicsSystems(flecs::world& world)
 
     world.observer<PhysicsHandleComponent>("Initialize Physics System")
          .event(flecs::OnAdd)
-         .each([](flecs::entity e, PhysicsHandleComponent& handle)
+         .each([&world](flecs::entity e, PhysicsHandleComponent& handle)
          {
-             JPH::RegisterDefaultAllocator();
+             InstallJoltAllocator();
 
              JPH::Trace = TraceImpl;
              JPH_IF_ENABLE_ASSERTS(JPH::AssertFailed = AssertFailedImpl);
@@ -51,26 +336,61 @@ res::PhysicsSystems::PhysicsSystems(flecs::world& world)
 
              JPH::RegisterTypes();
 
-             handle.temp_allocator = std::make_unique<JPH::TempAllocatorImpl>(10 * 1024 * 1024);
-             handle.job_system = std::make_unique<JPH::JobSystemThreadPool>(
-                 JPH::cMaxPhysicsJobs, JPH::cMaxPhysicsBarriers,
-                 std::thread::hardware_concurrency() - 1);
+             const auto* config_component = world.try_get<PhysicsConfigComponent>();
+             const PhysicsConfigComponent config = config_component != nullptr
+                                                       ? *config_component
+                                                       : PhysicsConfigComponent{};
 
-             constexpr JPH::uint kMaxBodies = 65536;
-             constexpr JPH::uint kNumBodyMutexes = 0;
-             constexpr JPH::uint kMaxBodyPairs = 65536;
-             constexpr JPH::uint kMaxContactConstraints = 10240;
+             handle.temp_allocator = std::make_unique<TrackingTempAllocator>(config.temp_allocator_size);
+
+             // Share the engine scheduler when there is one, otherwise physics gets a scheduler of its own
+             const auto* scheduler_component = world.try_get<TaskSchedulerComponent>();
+             if (scheduler_component != nullptr && scheduler_component->scheduler != nullptr)
+             {
+                 handle.job_system = scheduler_component->scheduler;
+             }
+             else
+             {
+                 handle.owned_job_system = std::make_unique<TaskScheduler>(config.scheduler);
+                 handle.job_system = handle.owned_job_system.get();
+             }
 
-             handle.broad_phase_layer_interface = std::make_unique<BPLayerInterfaceImpl>();
-             handle.object_vs_broad_phase_layer_filter = std::make_unique<ObjectVsBroadPhaseLayerFilterImpl>();
-             handle.object_vs_object_layer_filter = std::make_unique<ObjectLayerPairFilterImpl>();
+             const auto* layer_registry_component = world.try_get<PhysicsLayerRegistryComponent>();
+             handle.layer_registry = std::make_unique<PhysicsLayerRegistry>(
+                 layer_registry_component != nullptr
+                     ? layer_registry_component->registry
+                     : PhysicsLayerRegistry::CreateDefault());
+             handle.broad_phase_layer_interface = std::make_unique<BPLayerInterfaceImpl>(*handle.layer_registry);
+             handle.object_vs_broad_phase_layer_filter = std::make_unique<ObjectVsBroadPhaseLayerFilterImpl>(
+                 *handle.layer_registry);
+             handle.object_vs_object_layer_filter = std::make_unique<ObjectLayerPairFilterImpl>(
+                 *handle.layer_registry);
+             handle.contact_listener = std::make_unique<ContactCounterListener>();
 
              handle.physics_system = std::make_unique<JPH::PhysicsSystem>();
-             handle.physics_system->Init(kMaxBodies, kNumBodyMutexes, kMaxBodyPairs, kMaxContactConstraints,
-                                        *handle.broad_phase_layer_interface, *handle.object_vs_broad_phase_layer_filter,
+             handle.physics_system->Init(config.max_bodies, config.num_body_mutexes, config.max_body_pairs,
+                                        config.max_contact_constraints, *handle.broad_phase_layer_interface,
+                                        *handle.object_vs_broad_phase_layer_filter,
                                         *handle.object_vs_object_layer_filter);
+             handle.physics_system->SetContactListener(handle.contact_listener.get());
+
+             auto& telemetry = world.get_mut<PhysicsTelemetryComponent>();
+             telemetry.temp_allocator_size = config.temp_allocator_size;
+             telemetry.max_bodies = config.max_bodies;
+             telemetry.max_body_pairs = config.max_body_pairs;
+             telemetry.max_contact_constraints = config.max_contact_constraints;
+             telemetry.worker_count = handle.job_system->GetMaxConcurrency() - 1;
 
              handle.body_interface = &handle.physics_system->GetBodyInterface();
+             handle.body_interface_no_lock = &handle.physics_system->GetBodyInterfaceNoLock();
+
+             const auto* shape_cache_settings = world.try_get<ShapeCacheSettingsComponent>();
+             handle.shape_cache = std::make_unique<ShapeCache>(
+                 shape_cache_settings != nullptr ? shape_cache_settings->directory : std::string{});
+
+             const auto* crowd_settings = world.try_get<CharacterCrowdSettingsComponent>();
+             handle.character_crowd = std::make_unique<CharacterCrowd>(
+                 crowd_settings != nullptr ? crowd_settings->settings : CharacterCrowdSettings{});
          });
 
     world.observer<PhysicsHandleComponent>("Deinitialize Physics System")
@@ -85,32 +405,15 @@ res::PhysicsSystems::PhysicsSystems(flecs::world& world)
     world.observer<ModelComponent, PhysicsBodyIdComponent, MatrixComponent, MeshColliderComponent>(
              "Create StaticMesh Body")
          .event(flecs::OnAdd)
-         .each([&world](const ModelComponent& model_component, PhysicsBodyIdComponent& body_id_holder,
-                        MatrixComponent& matrix_component,
+         .each([&world](flecs::entity entity, const ModelComponent& model_component,
+                        PhysicsBodyIdComponent& body_id_holder, MatrixComponent& matrix_component,
                         const MeshColliderComponent& mesh_collider)
              {
-                 JPH::StaticCompoundShapeSettings static_compound_shape_settings{};
-                 AssembleStaticCompoundShape(static_compound_shape_settings, model_component);
-                 JPH::ShapeSettings::ShapeResult compound_shape_result = static_compound_shape_settings.Create();
-                 if (compound_shape_result.HasError())
-                 {
-                     spdlog::error("Failed to create a compound shape!");
-                 }
-
-                 JPH::ShapeRefC mesh_shape = compound_shape_result.Get();
-                 auto entity_position = GetPositionFromMatrix(matrix_component.matrix);
-                 auto entity_rotation = QuaternionNormalize(QuaternionFromMatrix(matrix_component.matrix));
-                 JPH::RVec3 body_position{entity_position.x, entity_position.y, entity_position.z};
-                 JPH::Quat body_rotation{entity_rotation.x, entity_rotation.y, entity_rotation.z, entity_rotation.w};
-                 JPH::BodyCreationSettings body_settings{
-                     mesh_shape, body_position, body_rotation, JPH::EMotionType::Static,
-                     PhysicsObjectLayers::NON_MOVING
-                 };
-
+                 // Cooking happens on the job system, the body is attached by "Attach Cooked Mesh Bodies"
                  auto& handle = world.get<PhysicsHandleComponent>();
-                 JPH::Body* body = handle.body_interface->CreateBody(body_settings);
-                 handle.body_interface->AddBody(body->GetID(), JPH::EActivation::DontActivate);
-                 body_id_holder.body_id = body->GetID();
+                 const std::uint64_t geometry_hash = handle.shape_cache->RequestStaticMeshShape(
+                     model_component.model, *handle.job_system);
+                 entity.set<PendingMeshColliderComponent>({geometry_hash});
              }
          );
 
@@ -118,23 +421,48 @@ res::PhysicsSystems::PhysicsSystems(flecs::world& world)
          .event(flecs::OnRemove)
          .each([&world](PhysicsBodyIdComponent& body_id_holder)
          {
+             // Bodies that were never created, e.g. colliders still cooking or entities that were just loaded
              if (body_id_holder.body_id.IsInvalid())
              {
-                 spdlog::error("Body Id is invalid!");
                  return;
              }
              auto& handle = world.get<PhysicsHandleComponent>();
-             handle.body_interface->RemoveBody(body_id_holder.body_id);
+             if (handle.body_interface->IsAdded(body_id_holder.body_id))
+             {
+                 handle.body_interface->RemoveBody(body_id_holder.body_id);
+             }
+             else
+             {
+                 DequeueBodyInsertion(world.get_mut<PhysicsBodyQueueComponent>(), body_id_holder.body_id);
+             }
              handle.body_interface->DestroyBody(body_id_holder.body_id);
          });
 
+    world.observer<const PhysicsLayerComponent, const PhysicsBodyIdComponent>("Update Body Layer")
+         .event(flecs::OnSet)
+         .each([&world](const PhysicsLayerComponent& layer_component, const PhysicsBodyIdComponent& body_id_holder)
+         {
+             if (body_id_holder.body_id.IsInvalid())
+             {
+                 return;
+             }
+             const auto& handle = world.get<PhysicsHandleComponent>();
+             if (layer_component.layer >= handle.layer_registry->GetNumObjectLayers())
+             {
+                 spdlog::error("Object layer {} is not registered!", layer_component.layer);
+                 return;
+             }
+             handle.body_interface->SetObjectLayer(body_id_holder.body_id, layer_component.layer);
+         });
+
     world.observer<const RigidbodySphereComponent, PhysicsBodyIdComponent>("Create Physics Ball")
          .event(flecs::OnAdd)
-         .each([&world](const RigidbodySphereComponent& rigidbody_sphere, PhysicsBodyIdComponent& body_id_holder)
+         .each([&world](flecs::entity entity, const RigidbodySphereComponent& rigidbody_sphere,
+                        PhysicsBodyIdComponent& body_id_holder)
          {
-             if (body_id_holder.body_id.IsInvalid())
+             if (!body_id_holder.body_id.IsInvalid())
              {
-                 spdlog::error("Body Id is invalid!");
+                 spdlog::error("Body Id is already assigned!");
                  return;
              }
              auto& handle = world.get<PhysicsHandleComponent>();
@@ -144,111 +472,344 @@ res::PhysicsSystems::PhysicsSystems(flecs::world& world)
              constexpr float kFriction = 0.0f;
              constexpr float kInitialVelocityY = -1.0f;
              
+             // Spawn where the entity is when it has a transform, e.g. when it was loaded from a snapshot
+             JPH::RVec3 position{0.0_r, kInitialHeight, 0.0_r};
+             JPH::Quat rotation = JPH::Quat::sIdentity();
+             if (const auto* matrix_component = entity.try_get<MatrixComponent>())
+             {
+                 const auto entity_position = GetPositionFromMatrix(matrix_component->matrix);
+                 const auto entity_rotation = QuaternionNormalize(QuaternionFromMatrix(matrix_component->matrix));
+                 position = JPH::RVec3(entity_position.x, entity_position.y, entity_position.z);
+                 rotation = JPH::Quat(entity_rotation.x, entity_rotation.y, entity_rotation.z, entity_rotation.w);
+             }
+
              JPH::BodyCreationSettings sphere_settings(new JPH::SphereShape(kSphereRadius),
-                                                      JPH::RVec3(0.0_r, kInitialHeight, 0.0_r),
-                                                      JPH::Quat::sIdentity(),
+                                                      position,
+                                                      rotation,
                                                       JPH::EMotionType::Dynamic,
-                                                      PhysicsObjectLayers::MOVING);
+                                                      GetEntityObjectLayer(entity, *handle.layer_registry,
+                                                                           PhysicsObjectLayers::MOVING));
              sphere_settings.mRestitution = kRestitution;
              sphere_settings.mFriction = kFriction;
-             body_id_holder.body_id = handle.body_interface->CreateAndAddBody(
-                 sphere_settings, JPH::EActivation::Activate);
+             sphere_settings.mUserData = entity.id();
+             sphere_settings.mLinearVelocity = JPH::Vec3(0.0f, kInitialVelocityY, 0.0f);
 
-             // Now you can interact with the dynamic body, in this case we're going to give it a velocity.
-             // (note that if we had used CreateBody then we could have set the velocity straight on the body before adding it to the physics system)
-             handle.body_interface->SetLinearVelocity(body_id_holder.body_id, JPH::Vec3(0.0f, kInitialVelocityY, 0.0f));
+             JPH::Body* body = handle.body_interface->CreateBody(sphere_settings);
+             if (body == nullptr)
+             {
+                 spdlog::error("Failed to create a body, the body limit is reached!");
+                 return;
+             }
+             body_id_holder.body_id = body->GetID();
+             QueueBodyInsertion(world.get_mut<PhysicsBodyQueueComponent>(), body->GetID(),
+                                JPH::EActivation::Activate);
          });
 
-    world.observer<const CharacterControllerComponent, PhysicsBodyIdComponent>("Create Character Capsule")
+    world.observer<const CharacterControllerComponent>("Create Character Capsule")
          .event(flecs::OnSet)
-         .each([&world](const CharacterControllerComponent& character_capsule, PhysicsBodyIdComponent& body_id_holder)
+         .each([&world](flecs::entity entity, const CharacterControllerComponent& character_capsule)
          {
              auto& handle = world.get<PhysicsHandleComponent>();
 
              constexpr float kMaxSlopeAngle = 45.0f;
-             constexpr float kCharacterFriction = 0.5f;
-             
+
+             // The character position is at its feet, MatrixComponent holds the center of the capsule
+             const JPH::Vec3 shape_offset{
+                 0.0f, 0.5f * character_capsule.character_height + character_capsule.character_radius, 0.0f
+             };
              JPH::RefConst capsule_shape = JPH::RotatedTranslatedShapeSettings(
-                                              JPH::Vec3(
-                                                  0, 0.5f * character_capsule.character_height +
-                                                  character_capsule.character_radius,
-                                                  0),
+                                              shape_offset,
                                               JPH::Quat::sIdentity(),
                                               new JPH::CapsuleShape(0.5f * character_capsule.character_height,
                                                                     character_capsule.character_radius)).
                                           Create().Get();
 
-             JPH::Ref character_settings = new JPH::CharacterSettings();
-             character_settings->mMaxSlopeAngle = kMaxSlopeAngle;
-             character_settings->mLayer = PhysicsObjectLayers::MOVING;
+             JPH::Ref character_settings = new JPH::CharacterVirtualSettings();
+             character_settings->mMaxSlopeAngle = JPH::DegreesToRadians(kMaxSlopeAngle);
              character_settings->mShape = capsule_shape;
-             character_settings->mFriction = kCharacterFriction;
              character_settings->mSupportingVolume = JPH::Plane(JPH::Vec3::sAxisY(), -character_capsule.character_radius);
-             auto character = new JPH::Character(character_settings, JPH::Vec3::sZero(), JPH::Quat::sIdentity(), 0,
-                                                 handle.physics_system.get());
-             body_id_holder.body_id = character->GetBodyID();
-             character->AddToPhysicsSystem(JPH::EActivation::Activate);
+
+             JPH::RVec3 position = JPH::RVec3::sZero();
+             if (const auto* matrix_component = entity.try_get<MatrixComponent>())
+             {
+                 const auto [x, y, z] = GetPositionFromMatrix(matrix_component->matrix);
+                 position = JPH::RVec3(x, y, z) - shape_offset;
+             }
+
+             // Setting the controller again rebuilds the character with the new dimensions
+             if (const auto* existing = entity.try_get<CharacterVirtualComponent>())
+             {
+                 handle.character_crowd->Remove(existing->character.GetPtr());
+             }
+
+             JPH::Ref character = new JPH::CharacterVirtual(character_settings, position, JPH::Quat::sIdentity(),
+                                                           entity.id(), handle.physics_system.get());
+             if (!handle.character_crowd->Add(character.GetPtr()))
+             {
+                 entity.remove<CharacterVirtualComponent>();
+                 return;
+             }
+             entity.set<CharacterVirtualComponent>({character});
+         });
+
+    world.observer<const CharacterVirtualComponent>("Remove Character")
+         .event(flecs::OnRemove)
+         .each([&world](const CharacterVirtualComponent& character_component)
+         {
+             const auto* handle = world.try_get<PhysicsHandleComponent>();
+             if (handle == nullptr || handle->character_crowd == nullptr || character_component.character == nullptr)
+             {
+                 return;
+             }
+             handle->character_crowd->Remove(character_component.character.GetPtr());
          });
 
 
-    world.system<const GravityComponent, PhysicsBodyIdComponent>("Apply Gravity")
+    world.system<const PendingMeshColliderComponent, PhysicsBodyIdComponent, const MatrixComponent>(
+             "Attach Cooked Mesh Bodies")
          .kind(on_tick_phase)
-         .each([&world](const GravityComponent& gravity_component, PhysicsBodyIdComponent& body_id_holder)
+         .each([&world](flecs::entity entity, const PendingMeshColliderComponent& pending_collider,
+                        PhysicsBodyIdComponent& body_id_holder, const MatrixComponent& matrix_component)
+         {
+             auto& handle = world.get<PhysicsHandleComponent>();
+             JPH::ShapeRefC mesh_shape{};
+             const ShapeStatus status = handle.shape_cache->TryGetShape(pending_collider.geometry_hash, mesh_shape);
+             if (status == ShapeStatus::kPending)
+             {
+                 return;
+             }
+
+             entity.remove<PendingMeshColliderComponent>();
+             if (status == ShapeStatus::kFailed)
+             {
+                 spdlog::error("Failed to create a compound shape!");
+                 return;
+             }
+
+             auto entity_position = GetPositionFromMatrix(matrix_component.matrix);
+             auto entity_rotation = QuaternionNormalize(QuaternionFromMatrix(matrix_component.matrix));
+             JPH::RVec3 body_position{entity_position.x, entity_position.y, entity_position.z};
+             JPH::Quat body_rotation{entity_rotation.x, entity_rotation.y, entity_rotation.z, entity_rotation.w};
+             JPH::BodyCreationSettings body_settings{
+                 mesh_shape, body_position, body_rotation, JPH::EMotionType::Static,
+                 GetEntityObjectLayer(entity, *handle.layer_registry, PhysicsObjectLayers::NON_MOVING)
+             };
+             body_settings.mUserData = entity.id();
+
+             JPH::Body* body = handle.body_interface->CreateBody(body_settings);
+             if (body == nullptr)
+             {
+                 spdlog::error("Failed to create a body, the body limit is reached!");
+                 return;
+             }
+             body_id_holder.body_id = body->GetID();
+             QueueBodyInsertion(world.get_mut<PhysicsBodyQueueComponent>(), body->GetID(),
+                                JPH::EActivation::DontActivate);
+         });
+
+    auto pending_collider_query = world.query<const PendingMeshColliderComponent>();
+
+    world.system("Update Mesh Collider Loading Progress")
+         .kind(on_tick_phase)
+         .run([&world, pending_collider_query](flecs::iter& it)
+         {
+             const auto& handle = world.get<PhysicsHandleComponent>();
+             const ShapeCacheProgress progress = handle.shape_cache->GetProgress();
+             auto& loading = world.get_mut<MeshColliderLoadingComponent>();
+             loading.requested_meshes = progress.requested_meshes;
+             loading.cooked_meshes = progress.cooked_meshes;
+             loading.pending_bodies = static_cast<std::uint32_t>(pending_collider_query.count());
+         });
+
+    // Per entity simulation systems run on the task threads. The physics handle is matched as a singleton term so
+    // every worker reads it through the iterator instead of looking it up on the world per entity
+    world.system<const PhysicsHandleComponent, const GravityComponent, const PhysicsBodyIdComponent>("Apply Gravity")
+         .term_at(0).singleton()
+         .kind(on_tick_phase)
+         .multi_threaded()
+         .each([](flecs::iter& it, size_t, const PhysicsHandleComponent& handle,
+                  const GravityComponent& gravity_component, const PhysicsBodyIdComponent& body_id_holder)
          {
              if (body_id_holder.body_id.IsInvalid())
              {
                  spdlog::error("Body Id is invalid! System: Apply Gravity");
                  return;
              }
-             auto& handle = world.get<PhysicsHandleComponent>();
-
-             auto current_position = handle.body_interface->GetCenterOfMassPosition(body_id_holder.body_id);
+             const float delta_time = it.delta_time();
+             const auto current_position = handle.body_interface_no_lock->GetCenterOfMassPosition(
+                 body_id_holder.body_id);
              handle.body_interface->MoveKinematic(body_id_holder.body_id,
-                                                 current_position + (gravity_component.gravity_force * GetFrameTime()),
-                                                 JPH::Quat::sIdentity(), GetFrameTime());
+                                                 current_position + (gravity_component.gravity_force * delta_time),
+                                                 JPH::Quat::sIdentity(), delta_time);
          });
 
-    world.system<const MovementInputComponent, const CharacterControllerComponent, const PhysicsBodyIdComponent>(
-             "Apply Character Movement Input")
+    world.system("Add Queued Bodies")
          .kind(on_tick_phase)
-         .each([&world](const MovementInputComponent& movement_input_component,
-                        const CharacterControllerComponent& character_component,
-                        const PhysicsBodyIdComponent& body_id_holder)
+         .run([&world](flecs::iter& it)
          {
-             if (body_id_holder.body_id.IsInvalid())
+             auto& queue = world.get_mut<PhysicsBodyQueueComponent>();
+             if (queue.activated_bodies.empty() && queue.inactive_bodies.empty())
              {
-                 spdlog::error("Body Id is invalid! System:Move Character with keys");
+                 queue.removed_bodies.clear();
                  return;
              }
+
              auto& handle = world.get<PhysicsHandleComponent>();
-             constexpr float kMovementSpeed = 5.0f;
-             auto movement = JPH::Vec3(movement_input_component.input.x * kMovementSpeed, 0.0f,
-                                       movement_input_component.input.y * kMovementSpeed);
-             handle.body_interface->SetLinearVelocity(body_id_holder.body_id, movement);
+             const int added_count =
+                 AddBodiesInBatch(*handle.body_interface, queue.activated_bodies, queue.removed_bodies,
+                                  JPH::EActivation::Activate) +
+                 AddBodiesInBatch(*handle.body_interface, queue.inactive_bodies, queue.removed_bodies,
+                                  JPH::EActivation::DontActivate);
+             queue.removed_bodies.clear();
+             queue.bodies_since_optimization += static_cast<std::uint32_t>(added_count);
+
+             // Inserting many bodies at once leaves the broadphase tree unbalanced until it is rebuilt
+             if (queue.optimize_broad_phase_threshold > 0 &&
+                 queue.bodies_since_optimization >= queue.optimize_broad_phase_threshold)
+             {
+                 handle.physics_system->OptimizeBroadPhase();
+                 queue.bodies_since_optimization = 0;
+             }
          });
 
+    world.observer<const PhysicsStepSettingsComponent>("Validate Physics Step Settings")
+         .event(flecs::OnSet)
+         .each([](const PhysicsStepSettingsComponent& settings)
+         {
+             if (settings.step_rate <= 0.0f)
+             {
+                 spdlog::error("Physics step rate {} is not positive, stepping at {} Hz instead", settings.step_rate,
+                               GetStepRate(settings));
+             }
+         });
 
     world.system("Run Physics Simulation")
+         .write<PhysicsActiveComponent>()
          .kind(on_tick_phase)
          .run([&world](flecs::iter& it)
          {
              auto& handle = world.get<PhysicsHandleComponent>();
-             constexpr int kCollisionSteps = 1;
-             handle.physics_system->Update(GetFrameTime(), kCollisionSteps, handle.temp_allocator.get(),
-                                          handle.job_system.get());
+             const auto& settings = world.get<PhysicsStepSettingsComponent>();
+             auto& state = world.get_mut<PhysicsStepStateComponent>();
+             auto& telemetry = world.get_mut<PhysicsTelemetryComponent>();
+             const float frame_time = it.delta_time();
+             UpdateBodyTelemetry(*handle.physics_system, telemetry);
+
+             if (!settings.use_fixed_step)
+             {
+                 CapturePreviousBodyStates(world, *handle.physics_system, state);
+                 StepPhysics(handle, frame_time, settings.collision_steps, telemetry);
+                 ++state.step_count;
+                 state.accumulator = 0.0f;
+                 state.alpha = 1.0f;
+                 state.step_delta = frame_time;
+                 state.steps_this_frame = 1;
+                 CaptureCurrentBodyStates(world, *handle.physics_system, state);
+                 return;
+             }
+
+             const float step_delta = 1.0f / GetStepRate(settings);
+             const float max_accumulated_time = step_delta * static_cast<float>(settings.max_steps_per_frame);
+
+             // Drop the time we cannot catch up on instead of spiraling into ever longer frames
+             state.accumulator = std::min(state.accumulator + frame_time, max_accumulated_time);
+             const int steps = std::min(static_cast<int>(state.accumulator / step_delta),
+                                        settings.max_steps_per_frame);
+
+             for (int step = 0; step < steps; ++step)
+             {
+                 if (step == steps - 1)
+                 {
+                     CapturePreviousBodyStates(world, *handle.physics_system, state);
+                 }
+                 StepPhysics(handle, step_delta, settings.collision_steps, telemetry);
+                 ++state.step_count;
+             }
+
+             if (steps > 0)
+             {
+                 CaptureCurrentBodyStates(world, *handle.physics_system, state);
+             }
+
+             state.accumulator = std::max(state.accumulator - static_cast<float>(steps) * step_delta, 0.0f);
+             state.alpha = std::clamp(state.accumulator / step_delta, 0.0f, 1.0f);
+             state.step_delta = step_delta;
+             state.steps_this_frame = steps;
+         });
+
+    // Characters move after the step so they collide with the bodies at their new positions. The crowd updates
+    // them in parallel batches on the job system
+    world.system<const CharacterVirtualComponent, const CharacterControllerComponent, const MovementInputComponent*>(
+             "Update Characters")
+         .kind(on_tick_phase)
+         .run([&world](flecs::iter& it)
+         {
+             const auto& handle = world.get<PhysicsHandleComponent>();
+             auto& state = world.get_mut<PhysicsStepStateComponent>();
+             const float delta_time = it.delta_time();
+             state.character_moves.clear();
+
+             while (it.next())
+             {
+                 const auto characters = it.field<const CharacterVirtualComponent>(0);
+                 const auto controllers = it.field<const CharacterControllerComponent>(1);
+                 const bool has_input = it.is_set(2);
+                 for (const auto i : it)
+                 {
+                     JPH::Vec3 desired_velocity = JPH::Vec3::sZero();
+                     if (has_input)
+                     {
+                         const Vector2 input = it.field_at<const MovementInputComponent>(2, i).input;
+                         desired_velocity = JPH::Vec3(input.x, 0.0f, input.y) * controllers[i].movement_speed;
+                     }
+                     state.character_moves.push_back({characters[i].character.GetPtr(), desired_velocity});
+                 }
+             }
+
+             // Long frames are clamped like the fixed step, so a hitch does not launch characters through walls
+             const auto& settings = world.get<PhysicsStepSettingsComponent>();
+             const float max_delta_time = static_cast<float>(settings.max_steps_per_frame) / GetStepRate(settings);
+             handle.character_crowd->Update(state.character_moves, std::min(delta_time, max_delta_time),
+                                            *handle.physics_system, *handle.job_system);
+
+             world.get_mut<PhysicsTelemetryComponent>().num_characters =
+                 static_cast<JPH::uint>(handle.character_crowd->GetCharacterCount());
          });
 
-    world.system<const PhysicsBodyIdComponent, MatrixComponent>("Move Physics Body")
+    world.system<const CharacterVirtualComponent, MatrixComponent, TransformStateComponent*>("Move Characters")
          .kind(on_tick_phase)
-         .each([&world](const PhysicsBodyIdComponent& body_id_component, MatrixComponent& matrix)
+         .multi_threaded()
+         .each([](const CharacterVirtualComponent& character_component, MatrixComponent& matrix_component,
+                  TransformStateComponent* transform_state)
          {
-             if (body_id_component.body_id.IsInvalid())
+             const JPH::CharacterVirtual& character = *character_component.character;
+             matrix_component.matrix = ToRaylibMatrix(character.GetCenterOfMassPosition(), character.GetRotation());
+             MarkWorldTransformChanged(transform_state);
+         });
+
+    // Only entities tagged as active after the last step are matched, the rest were snapped to their final pose
+    // when they fell asleep. Each worker writes only its own rows
+    world.system<const PhysicsStepSettingsComponent, const PhysicsStepStateComponent,
+                 const PhysicsInterpolationComponent, MatrixComponent, TransformStateComponent*>("Move Physics Body")
+         .term_at(0).singleton()
+         .term_at(1).singleton()
+         .with<PhysicsActiveComponent>()
+         .kind(on_tick_phase)
+         .multi_threaded()
+         .each([](const PhysicsStepSettingsComponent& settings, const PhysicsStepStateComponent& state,
+                  const PhysicsInterpolationComponent& interpolation, MatrixComponent& matrix_component,
+                  TransformStateComponent* transform_state)
+         {
+             if (!interpolation.initialized)
              {
-                 spdlog::error("Body Id is invalid! system: Move Physics Body");
                  return;
              }
-             auto& handle = world.get<PhysicsHandleComponent>();
-             auto position = handle.body_interface->GetCenterOfMassPosition(body_id_component.body_id);
-             matrix.matrix = MatrixTranslate(position.GetX(), position.GetY(), position.GetZ());
+
+             JPH::RVec3 position{};
+             JPH::Quat rotation{};
+             SmoothBodyState(interpolation, settings.smoothing_mode, state.alpha, state.step_delta, position,
+                             rotation);
+             matrix_component.matrix = ToRaylibMatrix(position, rotation);
+             MarkWorldTransformChanged(transform_state);
          });
 }
@@ -0,0 +1,267 @@
+#include "Profiler.h"
+
+#ifdef RES_PROFILER_ENABLED
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+
+#include <flecs.h>
+#include <spdlog/spdlog.h>
+
+#ifdef JPH_EXTERNAL_PROFILE
+#include <Jolt/Jolt.h>
+#endif
+
+#include "EcsUtils.h"
+
+
+namespace
+{
+    thread_local void* tls_thread_buffer = nullptr;
+
+    void WriteJsonString(std::ofstream& stream, const std::string_view text)
+    {
+        stream << '"';
+        for (const char character : text)
+        {
+            if (character == '"' || character == '\\')
+            {
+                stream << '\\';
+            }
+            stream << character;
+        }
+        stream << '"';
+    }
+
+    const char* GetCategoryName(const res::ProfileCategory category)
+    {
+        switch (category)
+        {
+        case res::ProfileCategory::kPhase:
+            return "phase";
+        case res::ProfileCategory::kSystem:
+            return "system";
+        case res::ProfileCategory::kPhysics:
+            return "physics";
+        case res::ProfileCategory::kScope:
+            return "scope";
+        }
+        return "scope";
+    }
+
+    void EcsPerfTracePush(const char* file_name, std::size_t line, const char* name)
+    {
+        res::Profiler::Get().PushScope(name, res::ProfileCategory::kSystem);
+    }
+
+    void EcsPerfTracePop(const char* file_name, std::size_t line, const char* name)
+    {
+        res::Profiler::Get().PopScope();
+    }
+}
+
+res::Profiler& res::Profiler::Get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+std::uint64_t res::Profiler::Now()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void res::Profiler::InstallEcsHooks()
+{
+    UpdateEcsOsApi([](ecs_os_api_t& os_api)
+    {
+        os_api.perf_trace_push_ = EcsPerfTracePush;
+        os_api.perf_trace_pop_ = EcsPerfTracePop;
+    });
+}
+
+void res::Profiler::SetHistorySize(const std::size_t frame_count)
+{
+    history_size_ = std::max<std::size_t>(frame_count, 1);
+    while (frames_.size() > history_size_)
+    {
+        frames_.pop_front();
+    }
+}
+
+void res::Profiler::NextFrame()
+{
+    const std::uint64_t now = Now();
+    if (frame_start_ns_ == 0)
+    {
+        frame_start_ns_ = now;
+        return;
+    }
+
+    ClosePhase(now);
+
+    ProfileFrame frame{frame_start_ns_, now, {}};
+    // Once the history is full the oldest frame hands its event storage to the new one
+    if (IsEnabled() && !frames_.empty() && frames_.size() >= history_size_)
+    {
+        frame.events = std::move(frames_.front().events);
+        frame.events.clear();
+        frames_.pop_front();
+    }
+    {
+        std::lock_guard buffers_lock{buffers_mutex_};
+        for (const std::unique_ptr<ThreadBuffer>& buffer : buffers_)
+        {
+            std::lock_guard lock{buffer->mutex};
+            frame.events.insert(frame.events.end(), buffer->events.begin(), buffer->events.end());
+            buffer->events.clear();
+        }
+    }
+
+    if (IsEnabled())
+    {
+        frames_.push_back(std::move(frame));
+        while (frames_.size() > history_size_)
+        {
+            frames_.pop_front();
+        }
+    }
+    frame_start_ns_ = now;
+}
+
+void res::Profiler::MarkPhase(const char* name)
+{
+    const std::uint64_t now = Now();
+    ClosePhase(now);
+    phase_name_ = name;
+    phase_start_ns_ = now;
+}
+
+void res::Profiler::ClosePhase(const std::uint64_t now)
+{
+    if (phase_name_ != nullptr)
+    {
+        Record({phase_name_, phase_start_ns_, now, 0, ProfileCategory::kPhase});
+        phase_name_ = nullptr;
+    }
+}
+
+void res::Profiler::Record(const ProfileEvent& event)
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+    ThreadBuffer& buffer = GetThreadBuffer();
+    std::lock_guard lock{buffer.mutex};
+    buffer.events.push_back(event);
+    buffer.events.back().thread_index = buffer.thread_index;
+}
+
+void res::Profiler::PushScope(const char* name, const ProfileCategory category)
+{
+    GetThreadBuffer().open_scopes.push_back({name, Now(), category});
+}
+
+void res::Profiler::PopScope()
+{
+    ThreadBuffer& buffer = GetThreadBuffer();
+    if (buffer.open_scopes.empty())
+    {
+        return;
+    }
+    const OpenScope scope = buffer.open_scopes.back();
+    buffer.open_scopes.pop_back();
+    Record({scope.name, scope.start_ns, Now(), 0, scope.category});
+}
+
+std::uint32_t res::Profiler::GetThreadCount() const
+{
+    std::lock_guard lock{buffers_mutex_};
+    return static_cast<std::uint32_t>(buffers_.size());
+}
+
+res::Profiler::ThreadBuffer& res::Profiler::GetThreadBuffer()
+{
+    if (tls_thread_buffer == nullptr)
+    {
+        std::lock_guard lock{buffers_mutex_};
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->thread_index = static_cast<std::uint32_t>(buffers_.size());
+        tls_thread_buffer = buffer.get();
+        buffers_.push_back(std::move(buffer));
+    }
+    return *static_cast<ThreadBuffer*>(tls_thread_buffer);
+}
+
+bool res::Profiler::ExportChromeTrace(const std::filesystem::path& path) const
+{
+    std::ofstream stream{path, std::ios::trunc};
+    if (!stream)
+    {
+        spdlog::error("Failed to open trace file {}", path.string());
+        return false;
+    }
+
+    const std::uint64_t origin_ns = frames_.empty() ? 0 : frames_.front().start_ns;
+    const auto to_microseconds = [origin_ns](const std::uint64_t time_ns)
+    {
+        return static_cast<double>(time_ns - origin_ns) / 1000.0;
+    };
+
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    const std::uint32_t thread_count = GetThreadCount();
+    for (std::uint32_t thread_index = 0; thread_index < thread_count; ++thread_index)
+    {
+        stream << (first ? "" : ",") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":" << thread_index
+            << ",\"args\":{\"name\":\"Thread " << thread_index << "\"}}";
+        first = false;
+    }
+
+    for (const ProfileFrame& frame : frames_)
+    {
+        for (const ProfileEvent& event : frame.events)
+        {
+            stream << (first ? "" : ",") << "{\"ph\":\"X\",\"name\":";
+            WriteJsonString(stream, event.name != nullptr ? event.name : "");
+            stream << ",\"cat\":\"" << GetCategoryName(event.category) << "\",\"pid\":0,\"tid\":"
+                << event.thread_index << ",\"ts\":" << to_microseconds(event.start_ns)
+                << ",\"dur\":" << static_cast<double>(event.end_ns - event.start_ns) / 1000.0 << "}";
+            first = false;
+        }
+        // Frame boundaries as instant events on the main thread
+        stream << (first ? "" : ",") << "{\"ph\":\"i\",\"name\":\"Frame\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":"
+            << to_microseconds(frame.start_ns) << "}";
+        first = false;
+    }
+    stream << "]}";
+    return static_cast<bool>(stream);
+}
+
+#ifdef JPH_EXTERNAL_PROFILE
+// Jolt leaves the implementation of its profile scopes to the application, the start time and name are kept in
+// the scope's user data
+JPH::ExternalProfileMeasurement::ExternalProfileMeasurement(const char* inName, uint32 inColor)
+{
+    static_assert(sizeof(mUserData) >= sizeof(const char*) + sizeof(std::uint64_t));
+    const std::uint64_t start_ns = res::Profiler::Now();
+    std::memcpy(mUserData, &inName, sizeof(inName));
+    std::memcpy(mUserData + sizeof(inName), &start_ns, sizeof(start_ns));
+}
+
+JPH::ExternalProfileMeasurement::~ExternalProfileMeasurement()
+{
+    const char* name = nullptr;
+    std::uint64_t start_ns = 0;
+    std::memcpy(&name, mUserData, sizeof(name));
+    std::memcpy(&start_ns, mUserData + sizeof(name), sizeof(start_ns));
+    res::Profiler::Get().Record({name, start_ns, res::Profiler::Now(), 0, res::ProfileCategory::kPhysics});
+}
+#endif
+
+#endif
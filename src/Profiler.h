@@ -0,0 +1,139 @@
+#pragma once
+
+// Everything below compiles to nothing unless RES_PROFILER_ENABLED is defined, see RES_ENABLE_PROFILER
+
+#ifdef RES_PROFILER_ENABLED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace res
+{
+    enum class ProfileCategory : std::uint8_t
+    {
+        kPhase,
+        kSystem,
+        kPhysics,
+        kScope
+    };
+
+    struct ProfileEvent
+    {
+        // Names are not copied, they have to outlive the recorded frames
+        const char* name{nullptr};
+        std::uint64_t start_ns{0};
+        std::uint64_t end_ns{0};
+        std::uint32_t thread_index{0};
+        ProfileCategory category{ProfileCategory::kScope};
+    };
+
+    struct ProfileFrame
+    {
+        std::uint64_t start_ns{0};
+        std::uint64_t end_ns{0};
+        std::vector<ProfileEvent> events;
+    };
+
+    // Process-wide frame profiler. Every thread records into a buffer of its own, the main thread gathers the
+    // buffers once per frame into a history of recent frames. Phases are timed by marker systems, flecs systems
+    // through the flecs performance trace hooks and Jolt through JPH_EXTERNAL_PROFILE
+    class Profiler
+    {
+    public:
+        [[nodiscard]] static Profiler& Get();
+        [[nodiscard]] static std::uint64_t Now();
+
+        // Routes the flecs performance trace hooks to the profiler. Call before the first flecs world is created
+        void InstallEcsHooks();
+
+        void SetEnabled(const bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+        [[nodiscard]] bool IsEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+        void SetHistorySize(std::size_t frame_count);
+
+        // Main thread only. Closes the current frame, gathers the events of every thread into it and opens the
+        // next frame
+        void NextFrame();
+        // Main thread only. Closes the span of the previous phase and opens one for name
+        void MarkPhase(const char* name);
+
+        void Record(const ProfileEvent& event);
+        // Scopes that open and close in separate calls on the same thread
+        void PushScope(const char* name, ProfileCategory category);
+        void PopScope();
+
+        // Main thread only, oldest frame first
+        [[nodiscard]] const std::deque<ProfileFrame>& GetFrames() const { return frames_; }
+        [[nodiscard]] std::uint32_t GetThreadCount() const;
+        // Writes the frame history in the Chrome trace event format, loadable in chrome://tracing or Perfetto
+        [[nodiscard]] bool ExportChromeTrace(const std::filesystem::path& path) const;
+
+    private:
+        struct OpenScope
+        {
+            const char* name{nullptr};
+            std::uint64_t start_ns{0};
+            ProfileCategory category{ProfileCategory::kScope};
+        };
+
+        struct ThreadBuffer
+        {
+            std::uint32_t thread_index{0};
+            // Only contended while the main thread gathers the events
+            std::mutex mutex;
+            std::vector<ProfileEvent> events;
+            std::vector<OpenScope> open_scopes;
+        };
+
+        Profiler() = default;
+
+        [[nodiscard]] ThreadBuffer& GetThreadBuffer();
+        void ClosePhase(std::uint64_t now);
+
+        std::atomic<bool> enabled_{true};
+        mutable std::mutex buffers_mutex_;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+
+        std::deque<ProfileFrame> frames_;
+        std::size_t history_size_{240};
+        std::uint64_t frame_start_ns_{0};
+        const char* phase_name_{nullptr};
+        std::uint64_t phase_start_ns_{0};
+    };
+
+    class ProfileScope
+    {
+    public:
+        explicit ProfileScope(const char* name):
+            name_{name}, start_ns_{Profiler::Now()}
+        {
+        }
+
+        ~ProfileScope()
+        {
+            Profiler::Get().Record({name_, start_ns_, Profiler::Now()});
+        }
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+    private:
+        const char* name_;
+        std::uint64_t start_ns_;
+    };
+}
+
+#define RES_PROFILE_CONCAT_INNER(a, b) a##b
+#define RES_PROFILE_CONCAT(a, b) RES_PROFILE_CONCAT_INNER(a, b)
+#define RES_PROFILE_SCOPE(name) const ::res::ProfileScope RES_PROFILE_CONCAT(res_profile_scope_, __LINE__){name}
+
+#else
+
+#define RES_PROFILE_SCOPE(name)
+
+#endif
@@ -1,7 +1,18 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <raylib.h>
 
+#include "AssetCache.h"
+#include "Culling.h"
+#include "InstancedRendering.h"
+#include "RenderQueue.h"
+
 namespace res {
 struct RenderableComponent {};
 
@@ -9,6 +20,63 @@ struct ModelComponent {
   Model model;
 };
 
+// Loads path through the asset cache, ModelComponent is set once it is ready.
+// Entities requesting the same file share one model
+struct ModelAssetComponent {
+  std::string path;
+};
+
+// Keeps the shared model of ModelComponent loaded while the entity uses it
+struct ModelHandleComponent {
+  ModelHandle handle;
+};
+
+// Present while the requested model is still loading
+struct PendingModelAssetComponent {};
+
+struct AssetCacheSettingsComponent {
+  int loader_thread_count{2};
+  // Main thread time spent parsing and uploading models per frame
+  double upload_budget_ms{4.0};
+};
+
+// Created on the first request
+struct AssetCacheComponent {
+  std::unique_ptr<AssetCache> cache;
+};
+
+// Detail levels 0 (full) to kMaxLodLevels - 1 (coarsest)
+constexpr int kMaxLodLevels = 3;
+
+// Detail level picked from the entity's size on screen, spheres and capsules
+// get one automatically
+struct LodComponent {
+  int level{0};
+};
+
+// Lower detail versions of the ModelComponent model, lower_detail[0] is drawn
+// at level 1. Levels past the end use the coarsest model given
+struct ModelLodComponent {
+  std::vector<Model> lower_detail;
+};
+
+struct LodSettingsComponent {
+  bool enabled{true};
+  // Projected bounds diameter in pixels below which level n + 1 is used
+  std::array<float, kMaxLodLevels - 1> screen_sizes{160.0f, 48.0f};
+  // Fraction a size has to move past a threshold before the level changes
+  float hysteresis{0.15f};
+};
+
+// Active camera data for LOD selection, updated once per frame
+struct LodViewComponent {
+  Vector3 position{0.0f, 0.0f, 0.0f};
+  // Pixels covered by one world unit at distance one, or at any distance for
+  // orthographic cameras
+  float projection_scale{0.0f};
+  bool perspective{true};
+};
+
 struct CameraComponent {
   Camera3D camera;
 };
@@ -23,4 +91,55 @@ struct GridPrimitiveComponent {
   int slices;
   float spacing;
 };
+
+// Local space bounds used for culling. Primitives and models get one when they
+// are added, renderables without one are never culled
+struct BoundsComponent {
+  BoundingBox local_bounds{};
+};
+
+// Written by the culling stage every frame, added with RenderableComponent
+struct VisibilityComponent {
+  bool visible{true};
+};
+
+// Bounding volume hierarchy over the world bounds of every renderable, rebuilt
+// when the set of renderables changes and refit otherwise. Refits stop after
+// rebuild_interval frames, or sooner once the tree's surface area grew past
+// max_refit_growth times its area when built
+struct CullingComponent {
+  bool enabled{true};
+  int rebuild_interval{120};
+  float max_refit_growth{1.5f};
+  int frames_since_build{0};
+  float built_surface_area{0.0f};
+  BoundingVolumeHierarchy bvh;
+  std::vector<BoundingBox> world_bounds;
+  std::vector<VisibilityComponent *> visibility;
+  std::vector<std::uint64_t> entities;
+  std::vector<std::uint64_t> previous_entities;
+  int visible_count{0};
+  int culled_count{0};
+};
+
+// Shared primitive meshes and the instancing shader. GPU resources are created
+// on the first frame drawn, once a window exists
+struct InstancedRenderingComponent {
+  bool loaded{false};
+  Shader shader{};
+  // colDiffuse of the shader, set per batch instead of through the materials
+  int tint_location{-1};
+  Material primitive_material{};
+  std::array<Mesh, kMaxLodLevels> sphere_meshes{};
+  std::array<Mesh, kMaxLodLevels> capsule_meshes{};
+  Mesh cube_mesh{};
+};
+
+// Packets emitted by the render systems this frame, drawn by "Submit Render
+// Queue" at the end of the 3D pass
+struct RenderQueueComponent {
+  RenderQueue queue;
+  int draw_calls{0};
+  int packet_count{0};
+};
 } // namespace res
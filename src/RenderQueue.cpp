@@ -0,0 +1,114 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <raymath.h>
+
+#include "HashUtils.h"
+
+namespace {
+constexpr int kStageBits = 2;
+constexpr int kDepthBits = 20;
+constexpr int kStateBits = 64 - kStageBits - kDepthBits;
+constexpr int kMeshBits = kStateBits / 2;
+constexpr int kMaterialBits = kStateBits - kMeshBits;
+constexpr int kRadixBits = 8;
+constexpr int kRadixBuckets = 1 << kRadixBits;
+
+constexpr std::uint64_t Mask(const int bits) {
+  return (std::uint64_t{1} << bits) - 1;
+}
+} // namespace
+
+void res::RenderQueue::Begin(const int thread_count,
+                             const Vector3 view_position,
+                             const float max_depth) {
+  thread_packets_.resize(static_cast<std::size_t>(std::max(thread_count, 1)));
+  for (RenderVector<RenderPacket> &packets : thread_packets_) {
+    packets.clear();
+  }
+  order_.clear();
+  view_position_ = view_position;
+  max_depth_ = std::max(max_depth, 1.0f);
+}
+
+std::uint64_t res::RenderQueue::MakeSortKey(const RenderStage stage,
+                                            const Mesh *mesh,
+                                            const Material *material,
+                                            const Color tint, const float depth,
+                                            const float max_depth) {
+  // Hashes only decide what sorts next to each other, batching compares the
+  // actual pointers
+  const std::uint64_t mesh_bits = HashValue(mesh) & Mask(kMeshBits);
+  const std::uint64_t material_bits =
+      HashValue(tint, HashValue(material)) & Mask(kMaterialBits);
+  const std::uint64_t state = (material_bits << kMeshBits) | mesh_bits;
+
+  const float normalized_depth = std::clamp(depth / max_depth, 0.0f, 1.0f);
+  auto depth_bits = static_cast<std::uint64_t>(
+      normalized_depth * static_cast<float>(Mask(kDepthBits)));
+  const auto stage_bits = static_cast<std::uint64_t>(stage)
+                          << (64 - kStageBits);
+
+  if (stage == RenderStage::kTransparent) {
+    // Back to front first, state only breaks ties
+    depth_bits = Mask(kDepthBits) - depth_bits;
+    return stage_bits | (depth_bits << kStateBits) | state;
+  }
+  return stage_bits | (state << kDepthBits) | depth_bits;
+}
+
+void res::RenderQueue::Push(const int thread_index, const RenderStage stage,
+                            RenderPacket packet) {
+  const Vector3 position{packet.transform.m12, packet.transform.m13,
+                         packet.transform.m14};
+  packet.sort_key =
+      MakeSortKey(stage, packet.mesh, packet.material, packet.tint,
+                  Vector3Distance(position, view_position_), max_depth_);
+  thread_packets_[static_cast<std::size_t>(thread_index)].push_back(packet);
+}
+
+void res::RenderQueue::Sort() {
+  order_.clear();
+  for (std::uint32_t thread_index = 0; thread_index < thread_packets_.size();
+       ++thread_index) {
+    const RenderVector<RenderPacket> &packets = thread_packets_[thread_index];
+    for (std::uint32_t packet_index = 0; packet_index < packets.size();
+         ++packet_index) {
+      order_.push_back(
+          {packets[packet_index].sort_key, thread_index, packet_index});
+    }
+  }
+
+  // Least significant digit first, skipping digits every key shares
+  scratch_.resize(order_.size());
+  for (int shift = 0; shift < 64; shift += kRadixBits) {
+    std::array<std::size_t, kRadixBuckets> offsets{};
+    for (const SortEntry &entry : order_) {
+      ++offsets[(entry.key >> shift) & Mask(kRadixBits)];
+    }
+    if (std::find(offsets.begin(), offsets.end(), order_.size()) !=
+        offsets.end()) {
+      continue;
+    }
+
+    std::size_t total = 0;
+    for (std::size_t &offset : offsets) {
+      const std::size_t count = offset;
+      offset = total;
+      total += count;
+    }
+    for (const SortEntry &entry : order_) {
+      scratch_[offsets[(entry.key >> shift) & Mask(kRadixBits)]++] = entry;
+    }
+    order_.swap(scratch_);
+  }
+}
+
+const res::RenderPacket &
+res::RenderQueue::GetSortedPacket(const std::size_t index) const {
+  const SortEntry &entry = order_[index];
+  return thread_packets_[entry.thread_index][entry.packet_index];
+}
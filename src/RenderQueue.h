@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <raylib.h>
+
+#include "MemoryTracking.h"
+
+namespace res {
+// Queues are drawn in this order, one after the other
+enum class RenderStage : std::uint8_t { kOpaque = 0, kTransparent = 1 };
+
+// Render queue storage, charged to the render memory tag
+template <typename T>
+using RenderVector = std::vector<T, TaggedAllocator<T, MemoryTag::kRender>>;
+
+struct RenderPacket {
+  std::uint64_t sort_key{0};
+  const Mesh *mesh{nullptr};
+  const Material *material{nullptr};
+  Color tint{WHITE};
+  Matrix transform{};
+};
+
+// Render packets emitted by any number of threads, each into its own list, and
+// sorted by a 64-bit key with a radix sort before submission. Opaque keys put
+// the mesh and material above the depth so state changes are minimal and
+// equal draws end up next to each other, transparent keys sort back to front.
+// Only touches CPU memory
+class RenderQueue {
+public:
+  // Drops the packets of the last frame and prepares one list per thread.
+  // Depth is quantized over 0..max_depth from the view position
+  void Begin(int thread_count, Vector3 view_position, float max_depth);
+
+  [[nodiscard]] static std::uint64_t MakeSortKey(RenderStage stage,
+                                                 const Mesh *mesh,
+                                                 const Material *material,
+                                                 Color tint, float depth,
+                                                 float max_depth);
+  // Fills in the sort key from the packet contents and its distance to the
+  // view position
+  void Push(int thread_index, RenderStage stage, RenderPacket packet);
+
+  // Gathers the packets of every thread and sorts them by key
+  void Sort();
+  [[nodiscard]] std::size_t GetPacketCount() const { return order_.size(); }
+  [[nodiscard]] const RenderPacket &GetSortedPacket(std::size_t index) const;
+
+  // Calls visitor for every run of sorted packets sharing mesh, material and
+  // tint, with the transforms of the run in order. Returns the run count
+  template <typename Visitor> int ForEachBatch(Visitor &&visitor);
+
+private:
+  struct SortEntry {
+    std::uint64_t key{0};
+    std::uint32_t thread_index{0};
+    std::uint32_t packet_index{0};
+  };
+
+  RenderVector<RenderVector<RenderPacket>> thread_packets_;
+  RenderVector<SortEntry> order_;
+  RenderVector<SortEntry> scratch_;
+  RenderVector<Matrix> batch_transforms_;
+  Vector3 view_position_{0.0f, 0.0f, 0.0f};
+  float max_depth_{1.0f};
+};
+
+namespace detail {
+[[nodiscard]] inline bool IsSameBatch(const RenderPacket &lhs,
+                                      const RenderPacket &rhs) {
+  return lhs.mesh == rhs.mesh && lhs.material == rhs.material &&
+         lhs.tint.r == rhs.tint.r && lhs.tint.g == rhs.tint.g &&
+         lhs.tint.b == rhs.tint.b && lhs.tint.a == rhs.tint.a;
+}
+} // namespace detail
+
+template <typename Visitor> int RenderQueue::ForEachBatch(Visitor &&visitor) {
+  int batch_count = 0;
+  std::size_t begin = 0;
+  while (begin < order_.size()) {
+    const RenderPacket &first = GetSortedPacket(begin);
+    batch_transforms_.clear();
+    std::size_t end = begin;
+    while (end < order_.size() &&
+           detail::IsSameBatch(first, GetSortedPacket(end))) {
+      batch_transforms_.push_back(GetSortedPacket(end).transform);
+      ++end;
+    }
+    visitor(first, batch_transforms_);
+    ++batch_count;
+    begin = end;
+  }
+  return batch_count;
+}
+} // namespace res
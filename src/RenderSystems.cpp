@@ -1,14 +1,134 @@
 #include "RenderSystems.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 #include <flecs.h>
 #include <raylib.h>
 #include <raymath.h>
+#include <rlgl.h>
 
+#include "AssetCache.h"
+#include "CommonComponents.h"
+#include "Culling.h"
+#include "InstancedRendering.h"
 #include "MathUtils.h"
 #include "Phases.h"
 #include "RenderComponents.h"
+#include "RenderQueue.h"
 #include "TransformComponents.h"
 
+namespace {
+constexpr Color kPrimitiveColor = RED;
+constexpr BoundingBox kUnitBounds{{-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}};
+constexpr BoundingBox kCapsuleBounds{{-0.5f, -1.5f, -0.5f}, {0.5f, 1.5f, 0.5f}};
+
+Color GetPrimitiveColor(const res::ColorComponent *color_component) {
+  return color_component != nullptr ? color_component->color : kPrimitiveColor;
+}
+
+// Tinted see-through draws go to the back to front sorted queue
+res::RenderStage GetRenderStage(const Color tint) {
+  return tint.a < 255 ? res::RenderStage::kTransparent
+                      : res::RenderStage::kOpaque;
+}
+
+// The first camera is the one culling and depth sorting use
+const res::CameraComponent *
+FindActiveCamera(const flecs::query<const res::CameraComponent> &camera_query) {
+  const res::CameraComponent *active_camera = nullptr;
+  camera_query.each([&active_camera](const res::CameraComponent &camera) {
+    if (active_camera == nullptr) {
+      active_camera = &camera;
+    }
+  });
+  return active_camera;
+}
+
+int SelectLodLevel(const int current_level, const float screen_size,
+                   const res::LodSettingsComponent &settings) {
+  // Coarser once clearly below a threshold, finer once clearly above it
+  int level = std::clamp(current_level, 0, res::kMaxLodLevels - 1);
+  while (level < res::kMaxLodLevels - 1 &&
+         screen_size < settings.screen_sizes[level] *
+                           (1.0f - settings.hysteresis)) {
+    ++level;
+  }
+  while (level > 0 && screen_size > settings.screen_sizes[level - 1] *
+                                        (1.0f + settings.hysteresis)) {
+    --level;
+  }
+  return level;
+}
+
+const Model &GetLodModel(const res::ModelComponent &model_component,
+                         const res::ModelLodComponent *model_lod,
+                         const res::LodComponent *lod) {
+  if (lod == nullptr || lod->level == 0 || model_lod == nullptr ||
+      model_lod->lower_detail.empty()) {
+    return model_component.model;
+  }
+  const auto index = std::min(static_cast<std::size_t>(lod->level - 1),
+                              model_lod->lower_detail.size() - 1);
+  return model_lod->lower_detail[index];
+}
+
+int GetLodLevel(const res::LodComponent *lod) {
+  return lod != nullptr ? lod->level : 0;
+}
+
+res::AssetCache &GetAssetCache(flecs::world &world) {
+  auto &cache_component = world.get_mut<res::AssetCacheComponent>();
+  if (cache_component.cache == nullptr) {
+    const auto &settings = world.get<res::AssetCacheSettingsComponent>();
+    cache_component.cache =
+        std::make_unique<res::AssetCache>(settings.loader_thread_count);
+  }
+  return *cache_component.cache;
+}
+
+void LoadInstancingResources(res::InstancedRenderingComponent &rendering) {
+  constexpr float kSphereRadius = 0.5f;
+  constexpr std::array<int, res::kMaxLodLevels> kSphereRings{16, 8, 4};
+  constexpr std::array<int, res::kMaxLodLevels> kSphereSlices{16, 10, 6};
+  constexpr float kCapsuleHeight = 2.0f;
+  constexpr float kCapsuleRadius = 0.5f;
+  constexpr std::array<int, res::kMaxLodLevels> kCapsuleRings{8, 4, 2};
+  constexpr std::array<int, res::kMaxLodLevels> kCapsuleSlices{8, 6, 4};
+  constexpr float kCubeSize = 1.0f;
+
+  rendering.shader = res::LoadInstancingShader();
+  // raylib would overwrite the tint with the material color on every draw
+  rendering.tint_location = rendering.shader.locs[SHADER_LOC_COLOR_DIFFUSE];
+  rendering.shader.locs[SHADER_LOC_COLOR_DIFFUSE] = -1;
+  rendering.primitive_material = LoadMaterialDefault();
+  for (int level = 0; level < res::kMaxLodLevels; ++level) {
+    rendering.sphere_meshes[level] =
+        GenMeshSphere(kSphereRadius, kSphereRings[level], kSphereSlices[level]);
+    rendering.capsule_meshes[level] =
+        res::GenMeshCapsule(kCapsuleRadius, kCapsuleHeight,
+                            kCapsuleRings[level], kCapsuleSlices[level]);
+  }
+  rendering.cube_mesh = GenMeshCube(kCubeSize, kCubeSize, kCubeSize);
+  rendering.loaded = true;
+}
+
+void UnloadInstancingResources(res::InstancedRenderingComponent &rendering) {
+  for (int level = 0; level < res::kMaxLodLevels; ++level) {
+    UnloadMesh(rendering.sphere_meshes[level]);
+    UnloadMesh(rendering.capsule_meshes[level]);
+  }
+  UnloadMesh(rendering.cube_mesh);
+  UnloadMaterial(rendering.primitive_material);
+  UnloadShader(rendering.shader);
+  rendering.loaded = false;
+}
+} // namespace
+
 res::RenderSystems::RenderSystems(flecs::world &world) {
   world.module<RenderSystems>();
 
@@ -28,6 +148,125 @@ res::RenderSystems::RenderSystems(flecs::world &world) {
   assert(on_render_3d_phase != 0 && "OnRender3DPhase not found!");
   assert(on_begin_phase != 0 && "OnBeginPhase not found!");
 
+  world.component<RenderableComponent>().add(
+      flecs::With, world.component<VisibilityComponent>());
+  world.add<InstancedRenderingComponent>();
+  world.add<RenderQueueComponent>();
+  world.add<CullingComponent>();
+  world.add<LodSettingsComponent>();
+  world.add<LodViewComponent>();
+  world.component<SpherePrimitiveComponent>().add(
+      flecs::With, world.component<LodComponent>());
+  world.component<CapsulePrimitiveComponent>().add(
+      flecs::With, world.component<LodComponent>());
+  world.add<AssetCacheSettingsComponent>();
+  world.add<AssetCacheComponent>();
+
+  world.observer<InstancedRenderingComponent>("Unload Instancing Resources")
+      .event(flecs::OnRemove)
+      .each([](InstancedRenderingComponent &rendering) {
+        if (rendering.loaded && IsWindowReady()) {
+          UnloadInstancingResources(rendering);
+        }
+      });
+
+  // The loader threads always stop, models are only unloaded while there is a
+  // context to unload them from
+  world.observer<AssetCacheComponent>("Release Asset Cache")
+      .event(flecs::OnRemove)
+      .each([](AssetCacheComponent &cache_component) {
+        if (cache_component.cache != nullptr) {
+          cache_component.cache->Shutdown(IsWindowReady());
+          cache_component.cache.reset();
+        }
+      });
+
+  world.observer<const ModelAssetComponent>("Request Model Asset")
+      .event(flecs::OnSet)
+      .each([&world](flecs::entity entity, const ModelAssetComponent &asset) {
+        // The previous model may be unloaded as soon as its handle is replaced
+        entity.remove<ModelComponent>();
+        entity.set<ModelHandleComponent>(
+            {GetAssetCache(world).RequestModel(asset.path)});
+        entity.add<PendingModelAssetComponent>();
+      });
+
+  world.observer<const ModelAssetComponent>("Release Model Asset")
+      .event(flecs::OnRemove)
+      .each([](flecs::entity entity, const ModelAssetComponent &) {
+        entity.remove<PendingModelAssetComponent>();
+        entity.remove<ModelComponent>();
+        entity.remove<ModelHandleComponent>();
+      });
+
+  world.observer<const ModelComponent>("Set Model Bounds")
+      .event(flecs::OnSet)
+      .each([](flecs::entity entity, const ModelComponent &model_component) {
+        // Shared models come with their bounds already computed
+        if (const auto *model_handle = entity.try_get<ModelHandleComponent>();
+            model_handle != nullptr &&
+            model_handle->handle->GetStatus() == AssetStatus::kReady) {
+          entity.set<BoundsComponent>({model_handle->handle->GetBounds()});
+          return;
+        }
+        entity.set<BoundsComponent>(
+            {GetModelBoundingBox(model_component.model)});
+      });
+
+  world.observer<const SpherePrimitiveComponent>("Set Sphere Bounds")
+      .event(flecs::OnAdd)
+      .each([](flecs::entity entity, const SpherePrimitiveComponent &sphere) {
+        if (!entity.has<BoundsComponent>()) {
+          entity.set<BoundsComponent>({kUnitBounds});
+        }
+      });
+
+  world.observer<const CapsulePrimitiveComponent>("Set Capsule Bounds")
+      .event(flecs::OnAdd)
+      .each([](flecs::entity entity, const CapsulePrimitiveComponent &capsule) {
+        if (!entity.has<BoundsComponent>()) {
+          entity.set<BoundsComponent>({kCapsuleBounds});
+        }
+      });
+
+  world.observer<const CubePrimitiveComponent>("Set Cube Bounds")
+      .event(flecs::OnAdd)
+      .each([](flecs::entity entity, const CubePrimitiveComponent &cube) {
+        if (!entity.has<BoundsComponent>()) {
+          entity.set<BoundsComponent>({kUnitBounds});
+        }
+      });
+
+  // OnBegin only runs on the first frame, so loading happens every frame
+  // before drawing starts instead
+  world.system<AssetCacheComponent, const AssetCacheSettingsComponent>(
+      "Update Asset Cache")
+      .term_at(0)
+      .singleton()
+      .term_at(1)
+      .singleton()
+      .kind(on_pre_render_phase)
+      .each([](AssetCacheComponent &cache_component,
+               const AssetCacheSettingsComponent &settings) {
+        if (cache_component.cache != nullptr) {
+          cache_component.cache->Update(settings.upload_budget_ms);
+        }
+      });
+
+  world.system<const ModelHandleComponent>("Resolve Model Assets")
+      .with<PendingModelAssetComponent>()
+      .kind(on_pre_render_phase)
+      .each([](flecs::entity entity, const ModelHandleComponent &model_handle) {
+        const AssetStatus status = model_handle.handle->GetStatus();
+        if (status == AssetStatus::kPending) {
+          return;
+        }
+        entity.remove<PendingModelAssetComponent>();
+        if (status == AssetStatus::kReady) {
+          entity.set<ModelComponent>({model_handle.handle->GetModel()});
+        }
+      });
+
   world.system("Begin Render")
       .kind(on_pre_render_phase)
       .run([](flecs::iter &it) {
@@ -42,6 +281,164 @@ res::RenderSystems::RenderSystems(flecs::world &world) {
         BeginMode3D(camera);
       });
 
+  // Marks every renderable inside the first camera's frustum as visible, the
+  // collect systems skip the rest
+  auto camera_query = world.query<const CameraComponent>();
+  world
+      .system<VisibilityComponent, const MatrixComponent,
+              const BoundsComponent *>("Cull Renderables")
+      .with<RenderableComponent>()
+      .kind(on_pre_render_3d_phase)
+      .run([&world, camera_query](flecs::iter &it) {
+        auto &culling = world.get_mut<CullingComponent>();
+        culling.world_bounds.clear();
+        culling.visibility.clear();
+        culling.entities.clear();
+
+        int always_visible = 0;
+        while (it.next()) {
+          auto visibility = it.field<VisibilityComponent>(0);
+          const auto matrices = it.field<const MatrixComponent>(1);
+          const bool has_bounds = it.is_set(2);
+          for (const auto i : it) {
+            if (!has_bounds) {
+              visibility[i].visible = true;
+              ++always_visible;
+              continue;
+            }
+            const auto &bounds = it.field_at<const BoundsComponent>(2, i);
+            culling.world_bounds.push_back(
+                TransformBoundingBox(bounds.local_bounds, matrices[i].matrix));
+            culling.visibility.push_back(&visibility[i]);
+            culling.entities.push_back(it.entity(i).id());
+          }
+        }
+
+        const CameraComponent *active_camera = FindActiveCamera(camera_query);
+
+        const int screen_height = GetScreenHeight();
+        if (!culling.enabled || active_camera == nullptr ||
+            screen_height <= 0) {
+          for (VisibilityComponent *visibility : culling.visibility) {
+            visibility->visible = true;
+          }
+          culling.visible_count =
+              always_visible + static_cast<int>(culling.visibility.size());
+          culling.culled_count = 0;
+          return;
+        }
+
+        bool rebuild = culling.entities != culling.previous_entities ||
+                       ++culling.frames_since_build >= culling.rebuild_interval;
+        if (!rebuild) {
+          culling.bvh.Refit(culling.world_bounds);
+          rebuild = culling.bvh.GetSurfaceArea() >
+                    culling.built_surface_area * culling.max_refit_growth;
+        }
+        if (rebuild) {
+          culling.bvh.Build(culling.world_bounds);
+          culling.previous_entities = culling.entities;
+          culling.frames_since_build = 0;
+          culling.built_surface_area = culling.bvh.GetSurfaceArea();
+        }
+
+        for (VisibilityComponent *visibility : culling.visibility) {
+          visibility->visible = false;
+        }
+
+        const float aspect = static_cast<float>(GetScreenWidth()) /
+                             static_cast<float>(screen_height);
+        const Frustum frustum = ExtractFrustum(
+            GetCameraViewProjection(active_camera->camera, aspect));
+        int visible_count = 0;
+        culling.bvh.Query(
+            frustum, culling.world_bounds,
+            [&culling, &visible_count](const std::uint32_t index) {
+              culling.visibility[index]->visible = true;
+              ++visible_count;
+            });
+
+        culling.visible_count = always_visible + visible_count;
+        culling.culled_count =
+            static_cast<int>(culling.world_bounds.size()) - visible_count;
+      });
+
+  world.system<RenderQueueComponent>("Begin Render Queue")
+      .term_at(0)
+      .singleton()
+      .kind(on_pre_render_3d_phase)
+      .run([&world, camera_query](flecs::iter &it) {
+        while (it.next()) {
+          auto &render_queue = it.field<RenderQueueComponent>(0)[0];
+          const CameraComponent *active_camera = FindActiveCamera(camera_query);
+          const Vector3 view_position = active_camera != nullptr
+                                            ? active_camera->camera.position
+                                            : Vector3{0.0f, 0.0f, 0.0f};
+          render_queue.queue.Begin(world.get_stage_count(), view_position,
+                                   static_cast<float>(rlGetCullDistanceFar()));
+        }
+      });
+
+  world.system<LodViewComponent>("Update LOD View")
+      .term_at(0)
+      .singleton()
+      .kind(on_pre_render_3d_phase)
+      .run([camera_query](flecs::iter &it) {
+        while (it.next()) {
+          auto &view = it.field<LodViewComponent>(0)[0];
+          const CameraComponent *active_camera = FindActiveCamera(camera_query);
+          if (active_camera == nullptr) {
+            continue;
+          }
+          // Pixels per world unit at distance one, or everywhere for ortho
+          const Camera3D &camera = active_camera->camera;
+          const auto screen_height = static_cast<float>(GetScreenHeight());
+          view.position = camera.position;
+          view.perspective = camera.projection != CAMERA_ORTHOGRAPHIC;
+          view.projection_scale =
+              view.perspective
+                  ? screen_height / (2.0f * std::tan(camera.fovy * DEG2RAD / 2))
+                  : screen_height / camera.fovy;
+        }
+      });
+
+  world
+      .system<LodComponent, const MatrixComponent, const BoundsComponent,
+              const VisibilityComponent, const LodSettingsComponent,
+              const LodViewComponent>("Select LOD")
+      .term_at(4)
+      .singleton()
+      .term_at(5)
+      .singleton()
+      .kind(on_pre_render_3d_phase)
+      .multi_threaded()
+      .each([](LodComponent &lod, const MatrixComponent &matrix_component,
+               const BoundsComponent &bounds,
+               const VisibilityComponent &visibility,
+               const LodSettingsComponent &settings,
+               const LodViewComponent &view) {
+        if (!visibility.visible) {
+          return;
+        }
+        if (!settings.enabled) {
+          lod.level = 0;
+          return;
+        }
+        // Projected diameter of the world bounds in pixels
+        const BoundingBox world_bounds =
+            TransformBoundingBox(bounds.local_bounds, matrix_component.matrix);
+        const Vector3 position =
+            Vector3Scale(Vector3Add(world_bounds.min, world_bounds.max), 0.5f);
+        const float diameter =
+            Vector3Length(Vector3Subtract(world_bounds.max, world_bounds.min));
+        float screen_size = diameter * view.projection_scale;
+        if (view.perspective) {
+          screen_size /=
+              std::max(Vector3Distance(position, view.position), EPSILON);
+        }
+        lod.level = SelectLodLevel(lod.level, screen_size, settings);
+      });
+
   world.system("End Render3D")
       .kind(on_post_render_3d_phase)
       .run([](flecs::iter &it) { EndMode3D(); });
@@ -54,62 +451,133 @@ res::RenderSystems::RenderSystems(flecs::world &world) {
       .kind(on_post_render_phase)
       .run([](flecs::iter &it) { EndDrawing(); });
 
+  // Render systems only emit packets and may run on any thread, each thread
+  // pushes into its own list of the queue
   world
-      .system<const RenderableComponent, const ModelComponent,
-              const MatrixComponent>("Render Models")
+      .system<RenderQueueComponent, const InstancedRenderingComponent,
+              const VisibilityComponent, const ModelComponent,
+              const MatrixComponent, const LodComponent *,
+              const ModelLodComponent *>("Emit Model Packets")
+      .with<RenderableComponent>()
+      .term_at(0)
+      .singleton()
+      .term_at(1)
+      .singleton()
       .kind(on_render_3d_phase)
-      .each([](const RenderableComponent &renderable,
+      .multi_threaded()
+      .each([](flecs::iter &it, size_t, RenderQueueComponent &render_queue,
+               const InstancedRenderingComponent &rendering,
+               const VisibilityComponent &visibility,
                const ModelComponent &model_component,
-               const MatrixComponent matrix_component) {
-        DrawModel(model_component.model,
-                  GetPositionFromMatrix(matrix_component.matrix), 1.0f, WHITE);
+               const MatrixComponent &matrix_component,
+               const LodComponent *lod, const ModelLodComponent *model_lod) {
+        if (!visibility.visible) {
+          return;
+        }
+        const int thread_index = it.world().get_stage_id();
+        const Model &model = GetLodModel(model_component, model_lod, lod);
+        // World matrix including rotation and scale
+        const Matrix transform =
+            MatrixMultiply(model.transform, matrix_component.matrix);
+        for (int mesh_index = 0; mesh_index < model.meshCount; ++mesh_index) {
+          const Material &material =
+              model.materials[model.meshMaterial[mesh_index]];
+          const Color tint = material.maps[MATERIAL_MAP_DIFFUSE].color;
+          render_queue.queue.Push(
+              thread_index, GetRenderStage(tint),
+              {0, &model.meshes[mesh_index], &material, tint, transform});
+        }
       });
 
   world
-      .system<const RenderableComponent, const SpherePrimitiveComponent,
-              const MatrixComponent>("Draw Spheres")
+      .system<RenderQueueComponent, const InstancedRenderingComponent,
+              const VisibilityComponent, const SpherePrimitiveComponent,
+              const MatrixComponent, const ColorComponent *,
+              const LodComponent *>(
+          "Emit Sphere Packets")
+      .with<RenderableComponent>()
+      .term_at(0)
+      .singleton()
+      .term_at(1)
+      .singleton()
       .kind(on_render_3d_phase)
-      .each([](const RenderableComponent &renderable,
+      .multi_threaded()
+      .each([](flecs::iter &it, size_t, RenderQueueComponent &render_queue,
+               const InstancedRenderingComponent &rendering,
+               const VisibilityComponent &visibility,
                const SpherePrimitiveComponent &sphere,
-               const MatrixComponent matrix_component) {
-        constexpr float kSphereRadius = 0.5f;
-        DrawSphere(GetPositionFromMatrix(matrix_component.matrix),
-                   kSphereRadius, RED);
+               const MatrixComponent &matrix_component,
+               const ColorComponent *color_component,
+               const LodComponent *lod) {
+        if (!visibility.visible) {
+          return;
+        }
+        const Color tint = GetPrimitiveColor(color_component);
+        render_queue.queue.Push(it.world().get_stage_id(),
+                                GetRenderStage(tint),
+                                {0, &rendering.sphere_meshes[GetLodLevel(lod)],
+                                 &rendering.primitive_material, tint,
+                                 matrix_component.matrix});
       });
 
   world
-      .system<const RenderableComponent, const CapsulePrimitiveComponent,
-              const MatrixComponent>("Draw Capsules")
+      .system<RenderQueueComponent, const InstancedRenderingComponent,
+              const VisibilityComponent, const CapsulePrimitiveComponent,
+              const MatrixComponent, const ColorComponent *,
+              const LodComponent *>(
+          "Emit Capsule Packets")
+      .with<RenderableComponent>()
+      .term_at(0)
+      .singleton()
+      .term_at(1)
+      .singleton()
       .kind(on_render_3d_phase)
-      .each([](const RenderableComponent &renderable,
+      .multi_threaded()
+      .each([](flecs::iter &it, size_t, RenderQueueComponent &render_queue,
+               const InstancedRenderingComponent &rendering,
+               const VisibilityComponent &visibility,
                const CapsulePrimitiveComponent &capsule,
-               const MatrixComponent matrix_component) {
-        constexpr float kCapsuleHeight = 2.0f;
-        constexpr float kCapsuleRadius = 0.5f;
-        constexpr int kCapsuleRings = 8;
-        constexpr int kCapsuleSlices = 8;
-        auto start_position = GetPositionFromMatrix(matrix_component.matrix);
-        start_position.y -= kCapsuleHeight / 2.0f;
-        auto end_position = start_position;
-        end_position.y += kCapsuleHeight;
-        DrawCapsule(start_position, end_position, kCapsuleRadius, kCapsuleRings,
-                    kCapsuleSlices, RED);
+               const MatrixComponent &matrix_component,
+               const ColorComponent *color_component,
+               const LodComponent *lod) {
+        if (!visibility.visible) {
+          return;
+        }
+        const Color tint = GetPrimitiveColor(color_component);
+        render_queue.queue.Push(it.world().get_stage_id(),
+                                GetRenderStage(tint),
+                                {0, &rendering.capsule_meshes[GetLodLevel(lod)],
+                                 &rendering.primitive_material, tint,
+                                 matrix_component.matrix});
       });
 
   world
-      .system<const RenderableComponent, const CubePrimitiveComponent,
-              const MatrixComponent>("Draw Cube")
+      .system<RenderQueueComponent, const InstancedRenderingComponent,
+              const VisibilityComponent, const CubePrimitiveComponent,
+              const MatrixComponent, const ColorComponent *>(
+          "Emit Cube Packets")
+      .with<RenderableComponent>()
+      .term_at(0)
+      .singleton()
+      .term_at(1)
+      .singleton()
       .kind(on_render_3d_phase)
-      .each([](const RenderableComponent &renderable,
+      .multi_threaded()
+      .each([](flecs::iter &it, size_t, RenderQueueComponent &render_queue,
+               const InstancedRenderingComponent &rendering,
+               const VisibilityComponent &visibility,
                const CubePrimitiveComponent &cube_component,
-               const MatrixComponent &matrix_component) {
-        constexpr float width = 1.0f;
-        constexpr float height = 1.0f;
-        constexpr float lenght = 1.0f;
-        constexpr Color color = RED;
-
-        DrawCube(GetPositionFromMatrix(matrix_component.matrix), width, height,
-                 lenght, color);
+               const MatrixComponent &matrix_component,
+               const ColorComponent *color_component) {
+        if (!visibility.visible) {
+          return;
+        }
+        const Color tint = GetPrimitiveColor(color_component);
+        render_queue.queue.Push(it.world().get_stage_id(),
+                                GetRenderStage(tint),
+                                {0, &rendering.cube_mesh,
+                                 &rendering.primitive_material, tint,
+                                 matrix_component.matrix});
       });
 
   world
@@ -121,6 +589,40 @@ res::RenderSystems::RenderSystems(flecs::world &world) {
         DrawGrid(grid.slices, grid.spacing);
       });
 
+  // Sorts the packets of every thread and draws each run of packets sharing a
+  // mesh, material and tint with one DrawMeshInstanced call
+  world
+      .system<RenderQueueComponent, InstancedRenderingComponent>(
+          "Submit Render Queue")
+      .term_at(0)
+      .singleton()
+      .term_at(1)
+      .singleton()
+      .kind(on_render_3d_phase)
+      .each([](RenderQueueComponent &render_queue,
+               InstancedRenderingComponent &rendering) {
+        if (!rendering.loaded) {
+          LoadInstancingResources(rendering);
+        }
+
+        render_queue.queue.Sort();
+        render_queue.packet_count =
+            static_cast<int>(render_queue.queue.GetPacketCount());
+        render_queue.draw_calls = render_queue.queue.ForEachBatch(
+            [&rendering](const RenderPacket &packet,
+                         const RenderVector<Matrix> &transforms) {
+              // Materials share their maps with every user, the tint goes
+              // straight to the shader instead
+              Material material = *packet.material;
+              material.shader = rendering.shader;
+              const Vector4 tint = ColorNormalize(packet.tint);
+              SetShaderValue(rendering.shader, rendering.tint_location, &tint,
+                             SHADER_UNIFORM_VEC4);
+              DrawMeshInstanced(*packet.mesh, material, transforms.data(),
+                                static_cast<int>(transforms.size()));
+            });
+      });
+
   world.system<CameraComponent, const MatrixComponent>()
       .kind(on_begin_phase)
       .each([](CameraComponent &camera_component,
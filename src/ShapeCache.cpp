@@ -0,0 +1,374 @@
+#include "ShapeCache.h"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <Jolt/Core/StreamIn.h>
+#include <Jolt/Core/StreamWrapper.h>
+#include <Jolt/Core/Color.h>
+#include <Jolt/Physics/Collision/PhysicsMaterial.h>
+#include <Jolt/Physics/Collision/Shape/MeshShape.h>
+#include <Jolt/Physics/Collision/Shape/StaticCompoundShape.h>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include "FileUtils.h"
+#include "HashUtils.h"
+#include "JoltUtils.h"
+#include "RenderComponents.h"
+
+
+namespace
+{
+    constexpr std::uint32_t kShapeFileMagic = 0x50485352; // "RSHP"
+    constexpr std::uint32_t kShapeFileVersion = 1;
+    constexpr const char* kShapeFileExtension = ".jshape";
+
+    struct ShapeFileHeader
+    {
+        std::uint32_t magic{kShapeFileMagic};
+        std::uint32_t version{kShapeFileVersion};
+        std::uint32_t jolt_version{JPH_VERSION_ID};
+        std::uint32_t reserved{0};
+        std::uint64_t geometry_hash{0};
+    };
+
+    // Reads straight out of a memory-mapped file
+    class MemoryStreamIn final : public JPH::StreamIn
+    {
+    public:
+        MemoryStreamIn(const std::byte* data, const std::size_t size):
+            data_{data}, size_{size}
+        {
+        }
+
+        void ReadBytes(void* out_data, const size_t num_bytes) override
+        {
+            if (offset_ + num_bytes > size_)
+            {
+                failed_ = true;
+                offset_ = size_;
+                return;
+            }
+            std::memcpy(out_data, data_ + offset_, num_bytes);
+            offset_ += num_bytes;
+        }
+
+        [[nodiscard]] bool IsEOF() const override
+        {
+            return offset_ >= size_;
+        }
+
+        [[nodiscard]] bool IsFailed() const override
+        {
+            return failed_;
+        }
+
+    private:
+        const std::byte* data_;
+        std::size_t size_;
+        std::size_t offset_{0};
+        bool failed_{false};
+    };
+}
+
+res::ShapeCache::ShapeCache(std::filesystem::path directory):
+    directory_{std::move(directory)}
+{
+    if (directory_.empty())
+    {
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+    if (error)
+    {
+        spdlog::error("Failed to create shape cache directory {}: {}", directory_.string(), error.message());
+        directory_.clear();
+    }
+}
+
+res::ShapeCache::~ShapeCache()
+{
+    // Cooking jobs reference the cache, so they have to finish before it goes away
+    for (const JPH::JobHandle& job : in_flight_jobs_)
+    {
+        while (!job.IsDone())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+JPH::ShapeRefC res::ShapeCache::GetOrCreateStaticMeshShape(const Model& model)
+{
+    const std::uint64_t geometry_hash = HashModelGeometry(model);
+    {
+        std::lock_guard lock{mutex_};
+        if (const auto it = entries_.find(geometry_hash); it != entries_.end() && it->second.status ==
+            ShapeStatus::kReady)
+        {
+            return it->second.shape;
+        }
+    }
+
+    if (JPH::ShapeRefC cached_shape = LoadFromDisk(geometry_hash))
+    {
+        Publish(geometry_hash, cached_shape);
+        return cached_shape;
+    }
+
+    ModelComponent model_component{model};
+    JPH::StaticCompoundShapeSettings static_compound_shape_settings{};
+    AssembleStaticCompoundShape(static_compound_shape_settings, model_component);
+    JPH::ShapeSettings::ShapeResult compound_shape_result = static_compound_shape_settings.Create();
+    if (compound_shape_result.HasError())
+    {
+        spdlog::error("Failed to create a compound shape: {}", compound_shape_result.GetError());
+        Publish(geometry_hash, nullptr);
+        return nullptr;
+    }
+
+    JPH::ShapeRefC shape = compound_shape_result.Get();
+    SaveToDisk(geometry_hash, *shape);
+    Publish(geometry_hash, shape);
+    return shape;
+}
+
+std::uint64_t res::ShapeCache::RequestStaticMeshShape(const Model& model, JPH::JobSystem& job_system)
+{
+    const std::uint64_t geometry_hash = HashModelGeometry(model);
+    {
+        std::lock_guard lock{mutex_};
+        if (entries_.contains(geometry_hash))
+        {
+            return geometry_hash;
+        }
+        entries_.emplace(geometry_hash, Entry{});
+
+        std::erase_if(in_flight_jobs_, [](const JPH::JobHandle& job) { return job.IsDone(); });
+    }
+
+    if (JPH::ShapeRefC cached_shape = LoadFromDisk(geometry_hash))
+    {
+        Publish(geometry_hash, cached_shape);
+        return geometry_hash;
+    }
+
+    // Without worker threads queued jobs would only run inside a physics barrier wait
+    if (job_system.GetMaxConcurrency() <= 1)
+    {
+        requested_meshes_ += static_cast<std::uint32_t>(model.meshCount);
+        [[maybe_unused]] const JPH::ShapeRefC shape = GetOrCreateStaticMeshShape(model);
+        cooked_meshes_ += static_cast<std::uint32_t>(model.meshCount);
+        return geometry_hash;
+    }
+
+    struct CookTask
+    {
+        std::vector<JPH::Ref<JPH::MeshShapeSettings>> mesh_settings;
+        std::vector<JPH::ShapeRefC> mesh_shapes;
+    };
+
+    // Copy the mesh data now, the model may be unloaded while the jobs are still running
+    auto task = std::make_shared<CookTask>();
+    task->mesh_settings.reserve(static_cast<std::size_t>(model.meshCount));
+    for (int mesh_index = 0; mesh_index < model.meshCount; ++mesh_index)
+    {
+        task->mesh_settings.push_back(CreateMeshShapeSettings(model.meshes[mesh_index]));
+    }
+    task->mesh_shapes.resize(task->mesh_settings.size());
+
+    const auto mesh_count = static_cast<JPH::uint32>(task->mesh_settings.size());
+    requested_meshes_ += mesh_count;
+
+    JPH::JobHandle compound_job = job_system.CreateJob(
+        "Assemble Cooked Compound", JPH::Color::sGreen, [this, task, geometry_hash]()
+        {
+            JPH::StaticCompoundShapeSettings static_compound_shape_settings{};
+            for (const JPH::ShapeRefC& mesh_shape : task->mesh_shapes)
+            {
+                if (mesh_shape != nullptr)
+                {
+                    static_compound_shape_settings.AddShape(JPH::Vec3::sZero(), JPH::Quat::sIdentity(), mesh_shape);
+                }
+            }
+
+            JPH::ShapeSettings::ShapeResult compound_shape_result = static_compound_shape_settings.Create();
+            if (compound_shape_result.HasError())
+            {
+                spdlog::error("Failed to create a compound shape: {}", compound_shape_result.GetError());
+                Publish(geometry_hash, nullptr);
+                return;
+            }
+
+            JPH::ShapeRefC shape = compound_shape_result.Get();
+            SaveToDisk(geometry_hash, *shape);
+            Publish(geometry_hash, shape);
+        }, mesh_count);
+
+    {
+        std::lock_guard lock{mutex_};
+        in_flight_jobs_.push_back(compound_job);
+    }
+
+    for (JPH::uint32 mesh_index = 0; mesh_index < mesh_count; ++mesh_index)
+    {
+        job_system.CreateJob("Cook Mesh Shape", JPH::Color::sOrange,
+                             [this, task, mesh_index, compound_job]()
+                             {
+                                 JPH::ShapeSettings::ShapeResult shape_result =
+                                     task->mesh_settings[mesh_index]->Create();
+                                 if (shape_result.HasError())
+                                 {
+                                     spdlog::error("Error creating shape: {}", shape_result.GetError());
+                                 }
+                                 else
+                                 {
+                                     task->mesh_shapes[mesh_index] = shape_result.Get();
+                                 }
+                                 ++cooked_meshes_;
+                                 compound_job.RemoveDependency();
+                             });
+    }
+
+    return geometry_hash;
+}
+
+res::ShapeStatus res::ShapeCache::TryGetShape(const std::uint64_t geometry_hash, JPH::ShapeRefC& out_shape) const
+{
+    std::lock_guard lock{mutex_};
+    const auto it = entries_.find(geometry_hash);
+    if (it == entries_.end())
+    {
+        return ShapeStatus::kFailed;
+    }
+    out_shape = it->second.shape;
+    return it->second.status;
+}
+
+res::ShapeCacheProgress res::ShapeCache::GetProgress() const
+{
+    return ShapeCacheProgress{requested_meshes_.load(), cooked_meshes_.load()};
+}
+
+void res::ShapeCache::Publish(const std::uint64_t geometry_hash, JPH::ShapeRefC shape)
+{
+    std::lock_guard lock{mutex_};
+    Entry& entry = entries_[geometry_hash];
+    entry.status = shape != nullptr ? ShapeStatus::kReady : ShapeStatus::kFailed;
+    entry.shape = std::move(shape);
+}
+
+std::uint64_t res::ShapeCache::HashModelGeometry(const Model& model)
+{
+    constexpr int kVertexComponents = 3;
+    constexpr int kIndicesPerTriangle = 3;
+
+    std::uint64_t hash = HashValue(model.meshCount);
+    for (int mesh_index = 0; mesh_index < model.meshCount; ++mesh_index)
+    {
+        const auto& mesh = model.meshes[mesh_index];
+        hash = HashValue(mesh.vertexCount, hash);
+        hash = HashValue(mesh.triangleCount, hash);
+        if (mesh.vertices != nullptr)
+        {
+            hash = HashBytes(mesh.vertices, sizeof(float) * kVertexComponents * mesh.vertexCount, hash);
+        }
+        if (mesh.indices != nullptr)
+        {
+            hash = HashBytes(mesh.indices, sizeof(unsigned short) * kIndicesPerTriangle * mesh.triangleCount,
+                             hash);
+        }
+    }
+    return hash;
+}
+
+std::filesystem::path res::ShapeCache::GetShapePath(const std::uint64_t geometry_hash) const
+{
+    return directory_ / (fmt::format("{:016x}", geometry_hash) + kShapeFileExtension);
+}
+
+JPH::ShapeRefC res::ShapeCache::LoadFromDisk(const std::uint64_t geometry_hash) const
+{
+    if (directory_.empty())
+    {
+        return nullptr;
+    }
+
+    const MappedFile file{GetShapePath(geometry_hash)};
+    if (!file.IsOpen() || file.GetSize() < sizeof(ShapeFileHeader))
+    {
+        return nullptr;
+    }
+
+    ShapeFileHeader header{};
+    std::memcpy(&header, file.GetData(), sizeof(header));
+    if (header.magic != kShapeFileMagic || header.version != kShapeFileVersion ||
+        header.jolt_version != JPH_VERSION_ID || header.geometry_hash != geometry_hash)
+    {
+        spdlog::warn("Ignoring stale shape cache entry {:016x}", geometry_hash);
+        return nullptr;
+    }
+
+    MemoryStreamIn stream{file.GetData() + sizeof(header), file.GetSize() - sizeof(header)};
+    JPH::Shape::IDToShapeMap shape_map{};
+    JPH::Shape::IDToMaterialMap material_map{};
+    JPH::ShapeSettings::ShapeResult shape_result = JPH::Shape::sRestoreWithChildren(stream, shape_map, material_map);
+    if (shape_result.HasError() || stream.IsFailed())
+    {
+        spdlog::warn("Failed to restore cached shape {:016x}", geometry_hash);
+        return nullptr;
+    }
+    return shape_result.Get();
+}
+
+void res::ShapeCache::SaveToDisk(const std::uint64_t geometry_hash, const JPH::Shape& shape) const
+{
+    if (directory_.empty())
+    {
+        return;
+    }
+
+    const std::filesystem::path shape_path = GetShapePath(geometry_hash);
+    std::filesystem::path temp_path = shape_path;
+    temp_path += ".tmp";
+
+    {
+        std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+        if (!file)
+        {
+            spdlog::error("Failed to open {} for writing", temp_path.string());
+            return;
+        }
+
+        ShapeFileHeader header{};
+        header.geometry_hash = geometry_hash;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        JPH::StreamOutWrapper stream{file};
+        JPH::Shape::ShapeToIDMap shape_map{};
+        JPH::Shape::MaterialToIDMap material_map{};
+        shape.SaveWithChildren(stream, shape_map, material_map);
+        if (stream.IsFailed() || !file)
+        {
+            spdlog::error("Failed to write cached shape {}", temp_path.string());
+            return;
+        }
+    }
+
+    // Rename last so a crash mid-write never leaves a truncated entry behind
+    std::error_code error;
+    std::filesystem::rename(temp_path, shape_path, error);
+    if (error)
+    {
+        spdlog::error("Failed to store cached shape {}: {}", shape_path.string(), error.message());
+        std::filesystem::remove(temp_path, error);
+    }
+}
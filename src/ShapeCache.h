@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/JobSystem.h>
+#include <Jolt/Physics/Collision/Shape/Shape.h>
+#include <raylib.h>
+
+namespace res
+{
+    enum class ShapeStatus
+    {
+        kPending,
+        kReady,
+        kFailed
+    };
+
+    struct ShapeCacheProgress
+    {
+        std::uint32_t requested_meshes{0};
+        std::uint32_t cooked_meshes{0};
+    };
+
+    // Cooked collision shapes keyed by a hash of the source mesh data. Shapes are shared between all instances of
+    // the same model and persisted to a cache directory so later runs skip cooking entirely.
+    // Requests may be cooked on the job system, one job per mesh followed by a job assembling the compound
+    class ShapeCache
+    {
+    public:
+        explicit ShapeCache(std::filesystem::path directory);
+        ~ShapeCache();
+
+        ShapeCache(const ShapeCache&) = delete;
+        ShapeCache& operator=(const ShapeCache&) = delete;
+
+        // Cooks on the calling thread when the shape is not cached yet
+        [[nodiscard]] JPH::ShapeRefC GetOrCreateStaticMeshShape(const Model& model);
+
+        // Returns the geometry hash to poll with TryGetShape. The mesh data is copied before returning
+        [[nodiscard]] std::uint64_t RequestStaticMeshShape(const Model& model, JPH::JobSystem& job_system);
+        [[nodiscard]] ShapeStatus TryGetShape(std::uint64_t geometry_hash, JPH::ShapeRefC& out_shape) const;
+        [[nodiscard]] ShapeCacheProgress GetProgress() const;
+
+        [[nodiscard]] static std::uint64_t HashModelGeometry(const Model& model);
+
+    private:
+        struct Entry
+        {
+            ShapeStatus status{ShapeStatus::kPending};
+            JPH::ShapeRefC shape;
+        };
+
+        [[nodiscard]] std::filesystem::path GetShapePath(std::uint64_t geometry_hash) const;
+        [[nodiscard]] JPH::ShapeRefC LoadFromDisk(std::uint64_t geometry_hash) const;
+        void SaveToDisk(std::uint64_t geometry_hash, const JPH::Shape& shape) const;
+        void Publish(std::uint64_t geometry_hash, JPH::ShapeRefC shape);
+
+        std::filesystem::path directory_;
+        mutable std::mutex mutex_;
+        std::unordered_map<std::uint64_t, Entry> entries_;
+        std::vector<JPH::JobHandle> in_flight_jobs_;
+        std::atomic<std::uint32_t> requested_meshes_{0};
+        std::atomic<std::uint32_t> cooked_meshes_{0};
+    };
+}
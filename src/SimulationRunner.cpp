@@ -0,0 +1,133 @@
+#include "SimulationRunner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string_view>
+#include <utility>
+
+#include <flecs.h>
+#include <raylib.h>
+#include <spdlog/spdlog.h>
+
+#include "FrameArena.h"
+#include "InputComponents.h"
+#include "InputSource.h"
+#include "Phases.h"
+
+
+namespace
+{
+    constexpr float kDefaultDeltaTime = 1.0f / 60.0f;
+
+    // flecs measures the frame time itself when it gets zero, which would make fixed and scripted runs depend on the
+    // wall clock
+    float GetValidDeltaTime(const float delta_time)
+    {
+        if (std::isfinite(delta_time) && delta_time > 0.0f)
+        {
+            return delta_time;
+        }
+        spdlog::warn("Delta time {} is not positive, using {}", delta_time, kDefaultDeltaTime);
+        return kDefaultDeltaTime;
+    }
+}
+
+
+float res::RaylibTimeSource::NextDeltaTime()
+{
+    return GetFrameTime();
+}
+
+res::FixedTimeSource::FixedTimeSource(const float delta_time):
+    delta_time_{GetValidDeltaTime(delta_time)}
+{
+}
+
+float res::FixedTimeSource::NextDeltaTime()
+{
+    return delta_time_;
+}
+
+res::ScriptedTimeSource::ScriptedTimeSource(std::vector<float> delta_times):
+    delta_times_{std::move(delta_times)}
+{
+    if (delta_times_.empty())
+    {
+        delta_times_.push_back(kDefaultDeltaTime);
+    }
+    for (float& delta_time : delta_times_)
+    {
+        delta_time = GetValidDeltaTime(delta_time);
+    }
+}
+
+float res::ScriptedTimeSource::NextDeltaTime()
+{
+    const float delta_time = delta_times_[next_index_];
+    next_index_ = std::min(next_index_ + 1, delta_times_.size() - 1);
+    return delta_time;
+}
+
+res::SimulationRunner::SimulationRunner(flecs::world& world, std::unique_ptr<TimeSource> time_source,
+                                        const bool headless):
+    world_{world}, time_source_{std::move(time_source)}, headless_{headless}
+{
+    if (!headless_)
+    {
+        return;
+    }
+
+    DisableRenderPhases();
+    scripted_input_ = std::make_shared<ScriptedInputSource>();
+    world_.set<InputSourceComponent>({scripted_input_});
+}
+
+bool res::SimulationRunner::Step()
+{
+    const float delta_time = time_source_->NextDeltaTime();
+    ++frame_count_;
+    simulated_time_ += delta_time;
+    const bool running = world_.progress(delta_time);
+    // The post render phase resets the frame arenas, headless runners have it disabled
+    if (headless_)
+    {
+        ResetFrameArenas();
+    }
+    return running;
+}
+
+std::uint64_t res::SimulationRunner::Run(const std::uint64_t frame_count)
+{
+    for (std::uint64_t frame = 0; frame < frame_count; ++frame)
+    {
+        if (!Step())
+        {
+            return frame + 1;
+        }
+    }
+    return frame_count;
+}
+
+void res::SimulationRunner::RunUntilClosed()
+{
+    while ((headless_ || !WindowShouldClose()) && Step())
+    {
+    }
+}
+
+void res::SimulationRunner::DisableRenderPhases() const
+{
+    // Systems in a disabled phase are left out of the pipeline
+    for (const std::string_view phase_name : {kPreRenderPhaseName, kRenderPhaseName, kPreRender3DPhaseName,
+                                              kRender3DPhaseName, kPostRender3DPhaseName, kRender2DPhaseName,
+                                              kPostRenderPhaseName})
+    {
+        const flecs::entity phase = world_.lookup(phase_name.data());
+        if (phase == 0)
+        {
+            spdlog::error("Phase {} not found, create the phases before the runner", phase_name);
+            continue;
+        }
+        phase.disable();
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace flecs
+{
+    struct world;
+}
+
+namespace res
+{
+    class ScriptedInputSource;
+
+    // Delta time fed to every frame of the world
+    class TimeSource
+    {
+    public:
+        virtual ~TimeSource() = default;
+
+        [[nodiscard]] virtual float NextDeltaTime() = 0;
+    };
+
+    // Wall-clock frame time measured by raylib, needs the window
+    class RaylibTimeSource final : public TimeSource
+    {
+    public:
+        [[nodiscard]] float NextDeltaTime() override;
+    };
+
+    class FixedTimeSource final : public TimeSource
+    {
+    public:
+        // flecs measures the time itself for zero, a delta_time that is not positive is replaced by 60 Hz
+        explicit FixedTimeSource(float delta_time);
+
+        [[nodiscard]] float NextDeltaTime() override;
+
+    private:
+        float delta_time_;
+    };
+
+    // Plays back a list of frame times, the last one repeats once the list runs out. Times that are not positive
+    // are replaced by 60 Hz, an empty list runs at 60 Hz
+    class ScriptedTimeSource final : public TimeSource
+    {
+    public:
+        explicit ScriptedTimeSource(std::vector<float> delta_times);
+
+        [[nodiscard]] float NextDeltaTime() override;
+
+    private:
+        std::vector<float> delta_times_;
+        std::size_t next_index_{0};
+    };
+
+    // Progresses a world with the frame times of a time source. Headless runners disable every render phase and
+    // read input from a ScriptedInputSource, so the simulation runs without a window or GPU and as fast as the CPU
+    // allows
+    class SimulationRunner
+    {
+    public:
+        // Import the modules first, so the render phases and input source exist
+        SimulationRunner(flecs::world& world, std::unique_ptr<TimeSource> time_source, bool headless);
+
+        // Runs a single frame. Returns false once the world was asked to quit
+        bool Step();
+        // Returns the number of frames run, fewer than frame_count when the world quit early
+        std::uint64_t Run(std::uint64_t frame_count);
+        // Runs until the window is closed or the world quits, headless runners only stop on quit
+        void RunUntilClosed();
+
+        [[nodiscard]] bool IsHeadless() const { return headless_; }
+        [[nodiscard]] std::uint64_t GetFrameCount() const { return frame_count_; }
+        [[nodiscard]] double GetSimulatedTime() const { return simulated_time_; }
+        // Only set for headless runners
+        [[nodiscard]] ScriptedInputSource* GetScriptedInput() const { return scripted_input_.get(); }
+
+    private:
+        void DisableRenderPhases() const;
+
+        flecs::world& world_;
+        std::unique_ptr<TimeSource> time_source_;
+        std::shared_ptr<ScriptedInputSource> scripted_input_;
+        bool headless_;
+        std::uint64_t frame_count_{0};
+        double simulated_time_{0.0};
+    };
+}
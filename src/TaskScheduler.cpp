@@ -0,0 +1,440 @@
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <flecs.h>
+#include <spdlog/spdlog.h>
+
+#include "EcsUtils.h"
+#include "MemoryTracking.h"
+#include "Profiler.h"
+#include "ThreadUtils.h"
+
+
+namespace
+{
+    thread_local const res::TaskScheduler* tls_scheduler = nullptr;
+    thread_local int tls_worker_index = -1;
+}
+
+struct res::TaskScheduler::EcsTask
+{
+    void* (*callback)(void*){nullptr};
+    void* param{nullptr};
+    void* result{nullptr};
+    std::atomic<bool> done{false};
+};
+
+// A generation counter instead of a native condition variable, so a waiting worker can be woken by new jobs as
+// well as by the signal it waits for. Waking up without a signal is allowed by condition variable semantics
+struct res::TaskScheduler::EcsCondition
+{
+    std::atomic<std::uint64_t> generation{0};
+};
+
+res::TaskScheduler* res::TaskScheduler::ecs_instance_ = nullptr;
+
+res::TaskScheduler::TaskScheduler(const TaskSchedulerConfig& config)
+{
+    // The engine scheduler is usually created before physics installs Jolt's allocator
+    InstallJoltAllocator();
+
+    JobSystemWithBarrier::Init(config.max_barriers);
+    jobs_.Init(config.max_jobs, config.max_jobs);
+
+    const int worker_count = config.worker_count >= 0
+                                 ? config.worker_count
+                                 : std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+
+    queues_.reserve(static_cast<std::size_t>(worker_count));
+    for (int worker_index = 0; worker_index < worker_count; ++worker_index)
+    {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    workers_.reserve(static_cast<std::size_t>(worker_count));
+    for (int worker_index = 0; worker_index < worker_count; ++worker_index)
+    {
+        const int core_index = worker_index < static_cast<int>(config.worker_affinity.size())
+                                   ? config.worker_affinity[worker_index]
+                                   : -1;
+        workers_.emplace_back(&TaskScheduler::WorkerMain, this, worker_index, core_index);
+    }
+}
+
+res::TaskScheduler::~TaskScheduler()
+{
+    quit_.store(true);
+    WakeWorkers(true);
+    for (std::thread& worker : workers_)
+    {
+        worker.join();
+    }
+
+    if (ecs_instance_ == this)
+    {
+        ecs_instance_ = nullptr;
+    }
+
+    for (const auto& queue : queues_)
+    {
+        for (Job* job : queue->jobs)
+        {
+            job->Release();
+        }
+    }
+}
+
+int res::TaskScheduler::GetMaxConcurrency() const
+{
+    return static_cast<int>(workers_.size()) + 1;
+}
+
+JPH::JobHandle res::TaskScheduler::CreateJob(const char* name, const JPH::ColorArg color,
+                                             const JobFunction& job_function, const JPH::uint32 num_dependencies)
+{
+    JPH::uint32 job_index;
+    for (;;)
+    {
+        job_index = jobs_.ConstructObject(name, color, this, job_function, num_dependencies);
+        if (job_index != AvailableJobs::cInvalidObjectIndex)
+        {
+            break;
+        }
+        JPH_ASSERT(false, "No jobs available!");
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    Job* job = &jobs_.Get(job_index);
+
+    // The handle keeps the job alive, once queued it may complete right away
+    JobHandle handle{job};
+    if (num_dependencies == 0)
+    {
+        QueueJob(job);
+    }
+    return handle;
+}
+
+void res::TaskScheduler::InstallEcsHooks()
+{
+    ecs_instance_ = this;
+
+    UpdateEcsOsApi([](ecs_os_api_t& os_api)
+    {
+        os_api.task_new_ = EcsTaskNew;
+        os_api.task_join_ = EcsTaskJoin;
+        os_api.mutex_new_ = EcsMutexNew;
+        os_api.mutex_free_ = EcsMutexFree;
+        os_api.mutex_lock_ = EcsMutexLock;
+        os_api.mutex_unlock_ = EcsMutexUnlock;
+        os_api.cond_new_ = EcsCondNew;
+        os_api.cond_free_ = EcsCondFree;
+        os_api.cond_signal_ = EcsCondSignal;
+        os_api.cond_broadcast_ = EcsCondSignal;
+        os_api.cond_wait_ = EcsCondWait;
+    });
+
+#ifdef RES_PROFILER_ENABLED
+    // The engine installs every flecs hook here, so profiled builds trace systems without a call of their own
+    Profiler::Get().InstallEcsHooks();
+#endif
+}
+
+void res::TaskScheduler::AttachWorld(flecs::world& world)
+{
+    if (ecs_instance_ != this)
+    {
+        spdlog::error("TaskScheduler::InstallEcsHooks must be called before attaching a world");
+    }
+    else if (ecs_os_api.task_new_ != EcsTaskNew)
+    {
+        spdlog::error("The flecs task hooks of the TaskScheduler were replaced, the world runs without workers");
+    }
+    else if (!workers_.empty())
+    {
+        world.set_task_threads(static_cast<std::int32_t>(workers_.size()));
+    }
+    world.set<TaskSchedulerComponent>({this});
+}
+
+void res::TaskScheduler::QueueJob(Job* job)
+{
+    PushJob(job);
+    WakeWorkers(false);
+}
+
+void res::TaskScheduler::QueueJobs(Job** jobs, const JPH::uint job_count)
+{
+    for (JPH::uint job_index = 0; job_index < job_count; ++job_index)
+    {
+        PushJob(jobs[job_index]);
+    }
+    WakeWorkers(job_count > 1);
+}
+
+void res::TaskScheduler::FreeJob(Job* job)
+{
+    jobs_.DestructObject(job);
+}
+
+void res::TaskScheduler::WorkerMain(const int worker_index, const int core_index)
+{
+    tls_scheduler = this;
+    tls_worker_index = worker_index;
+    if (core_index >= 0 && !PinCurrentThreadToCore(core_index))
+    {
+        spdlog::warn("Failed to pin worker {} to core {}", worker_index, core_index);
+    }
+
+    while (!quit_.load())
+    {
+        // flecs tasks block until their pipeline is done, so they are only picked up here and never from inside
+        // another blocked task
+        if (EcsTask* task = PopEcsTask())
+        {
+            task->result = task->callback(task->param);
+            task->done.store(true, std::memory_order_release);
+            task->done.notify_all();
+            continue;
+        }
+
+        if (RunOneJob(worker_index))
+        {
+            continue;
+        }
+
+        std::unique_lock lock{sleep_mutex_};
+        worker_wake_.wait(lock, [this]()
+        {
+            return quit_.load() || pending_jobs_.load() > 0 || pending_ecs_tasks_.load() > 0;
+        });
+    }
+}
+
+void res::TaskScheduler::PushJob(Job* job)
+{
+    // Without workers the job only runs when a barrier waits for it
+    if (queues_.empty())
+    {
+        return;
+    }
+
+    job->AddRef();
+    const std::size_t queue_index = tls_scheduler == this
+                                        ? static_cast<std::size_t>(tls_worker_index)
+                                        : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        std::lock_guard lock{queues_[queue_index]->mutex};
+        queues_[queue_index]->jobs.push_back(job);
+    }
+    pending_jobs_.fetch_add(1, std::memory_order_release);
+}
+
+res::TaskScheduler::Job* res::TaskScheduler::PopJob(const int worker_index)
+{
+    if (pending_jobs_.load(std::memory_order_acquire) <= 0)
+    {
+        return nullptr;
+    }
+
+    const std::size_t queue_count = queues_.size();
+    for (std::size_t offset = 0; offset < queue_count; ++offset)
+    {
+        const bool is_own_queue = offset == 0;
+        WorkerQueue& queue = *queues_[(static_cast<std::size_t>(worker_index) + offset) % queue_count];
+
+        std::lock_guard lock{queue.mutex};
+        if (queue.jobs.empty())
+        {
+            continue;
+        }
+
+        // Newest first from the own queue keeps caches warm, oldest first when stealing takes the larger work
+        Job* job;
+        if (is_own_queue)
+        {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+        pending_jobs_.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    }
+    return nullptr;
+}
+
+bool res::TaskScheduler::RunOneJob(const int worker_index)
+{
+    Job* job = PopJob(worker_index);
+    if (job == nullptr)
+    {
+        return false;
+    }
+    job->Execute();
+    job->Release();
+    return true;
+}
+
+res::TaskScheduler::EcsTask* res::TaskScheduler::PopEcsTask()
+{
+    if (pending_ecs_tasks_.load(std::memory_order_acquire) <= 0)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard lock{ecs_task_mutex_};
+    if (ecs_tasks_.empty())
+    {
+        return nullptr;
+    }
+    EcsTask* task = ecs_tasks_.front();
+    ecs_tasks_.pop_front();
+    pending_ecs_tasks_.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+void res::TaskScheduler::WakeWorkers(const bool wake_all)
+{
+    // Taking the lock orders this wake-up after a worker that just checked its wait condition went to sleep
+    {
+        std::lock_guard lock{sleep_mutex_};
+    }
+    if (wake_all)
+    {
+        worker_wake_.notify_all();
+    }
+    else
+    {
+        worker_wake_.notify_one();
+    }
+}
+
+std::uintptr_t res::TaskScheduler::EcsTaskNew(void* (*callback)(void*), void* param)
+{
+    TaskScheduler* scheduler = ecs_instance_;
+    auto* task = new EcsTask{};
+    task->callback = callback;
+    task->param = param;
+
+    if (scheduler == nullptr || scheduler->workers_.empty())
+    {
+        spdlog::error("flecs task started without scheduler workers");
+        task->result = callback(param);
+        task->done.store(true);
+        return reinterpret_cast<std::uintptr_t>(task);
+    }
+
+    {
+        std::lock_guard lock{scheduler->ecs_task_mutex_};
+        scheduler->ecs_tasks_.push_back(task);
+    }
+    scheduler->pending_ecs_tasks_.fetch_add(1, std::memory_order_release);
+    scheduler->WakeWorkers(true);
+    return reinterpret_cast<std::uintptr_t>(task);
+}
+
+void* res::TaskScheduler::EcsTaskJoin(const std::uintptr_t task_handle)
+{
+    auto* task = reinterpret_cast<EcsTask*>(task_handle);
+    task->done.wait(false, std::memory_order_acquire);
+    void* result = task->result;
+    delete task;
+    return result;
+}
+
+std::uintptr_t res::TaskScheduler::EcsMutexNew()
+{
+    return reinterpret_cast<std::uintptr_t>(new std::mutex{});
+}
+
+void res::TaskScheduler::EcsMutexFree(const std::uintptr_t mutex_handle)
+{
+    delete reinterpret_cast<std::mutex*>(mutex_handle);
+}
+
+void res::TaskScheduler::EcsMutexLock(const std::uintptr_t mutex_handle)
+{
+    reinterpret_cast<std::mutex*>(mutex_handle)->lock();
+}
+
+void res::TaskScheduler::EcsMutexUnlock(const std::uintptr_t mutex_handle)
+{
+    reinterpret_cast<std::mutex*>(mutex_handle)->unlock();
+}
+
+std::uintptr_t res::TaskScheduler::EcsCondNew()
+{
+    return reinterpret_cast<std::uintptr_t>(new EcsCondition{});
+}
+
+void res::TaskScheduler::EcsCondFree(const std::uintptr_t cond_handle)
+{
+    delete reinterpret_cast<EcsCondition*>(cond_handle);
+}
+
+void res::TaskScheduler::EcsCondSignal(const std::uintptr_t cond_handle)
+{
+    reinterpret_cast<EcsCondition*>(cond_handle)->generation.fetch_add(1, std::memory_order_acq_rel);
+
+    if (TaskScheduler* scheduler = ecs_instance_)
+    {
+        {
+            std::lock_guard lock{scheduler->sleep_mutex_};
+        }
+        scheduler->worker_wake_.notify_all();
+        scheduler->external_wake_.notify_all();
+    }
+}
+
+void res::TaskScheduler::EcsCondWait(const std::uintptr_t cond_handle, const std::uintptr_t mutex_handle)
+{
+    const auto* condition = reinterpret_cast<EcsCondition*>(cond_handle);
+    auto* mutex = reinterpret_cast<std::mutex*>(mutex_handle);
+
+    // Read while the caller still holds the mutex, so a signal sent after unlocking is never missed
+    const std::uint64_t generation = condition->generation.load(std::memory_order_acquire);
+    const auto is_signaled = [condition, generation]()
+    {
+        return condition->generation.load(std::memory_order_acquire) != generation;
+    };
+
+    mutex->unlock();
+
+    TaskScheduler* scheduler = ecs_instance_;
+    if (scheduler == nullptr)
+    {
+        while (!is_signaled())
+        {
+            std::this_thread::yield();
+        }
+    }
+    else if (tls_scheduler == scheduler)
+    {
+        // A worker blocked on a flecs sync point keeps executing jobs instead of idling
+        while (!is_signaled() && !scheduler->quit_.load())
+        {
+            if (scheduler->RunOneJob(tls_worker_index))
+            {
+                continue;
+            }
+
+            std::unique_lock lock{scheduler->sleep_mutex_};
+            scheduler->worker_wake_.wait(lock, [scheduler, &is_signaled]()
+            {
+                return is_signaled() || scheduler->pending_jobs_.load() > 0 || scheduler->quit_.load();
+            });
+        }
+    }
+    else
+    {
+        std::unique_lock lock{scheduler->sleep_mutex_};
+        scheduler->external_wake_.wait(lock, is_signaled);
+    }
+
+    mutex->lock();
+}
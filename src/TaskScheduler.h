@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/FixedSizeFreeList.h>
+#include <Jolt/Core/JobSystemWithBarrier.h>
+#include <Jolt/Physics/PhysicsSettings.h>
+
+namespace flecs
+{
+    struct world;
+}
+
+namespace res
+{
+    class TaskScheduler;
+
+    struct TaskSchedulerConfig
+    {
+        // Negative means one worker per hardware thread, minus the main thread
+        int worker_count{-1};
+        // Core for each worker thread by index, workers beyond the list are not pinned
+        std::vector<int> worker_affinity;
+        JPH::uint max_jobs{JPH::cMaxPhysicsJobs};
+        JPH::uint max_barriers{JPH::cMaxPhysicsBarriers};
+    };
+
+    // Set by TaskScheduler::AttachWorld, engine modules take their job system from here
+    struct TaskSchedulerComponent
+    {
+        TaskScheduler* scheduler{nullptr};
+    };
+
+    // Engine-wide work-stealing scheduler. Jolt uses it as its job system and flecs runs its worker tasks on it,
+    // so physics jobs and multi-threaded systems share one set of threads. Each worker owns a job deque, pops its
+    // own jobs newest first and steals the oldest jobs of other workers when it runs dry. Workers blocked inside a
+    // flecs synchronization point keep executing jobs until they are released.
+    class TaskScheduler final : public JPH::JobSystemWithBarrier
+    {
+    public:
+        explicit TaskScheduler(const TaskSchedulerConfig& config);
+        ~TaskScheduler() override;
+
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+        [[nodiscard]] int GetMaxConcurrency() const override;
+        JobHandle CreateJob(const char* name, JPH::ColorArg color, const JobFunction& job_function,
+                            JPH::uint32 num_dependencies = 0) override;
+
+        [[nodiscard]] int GetWorkerCount() const { return static_cast<int>(workers_.size()); }
+
+        // Routes the flecs OS API task, mutex and condition hooks to this scheduler. Call before the first flecs
+        // world is created, and keep the scheduler alive until the last world is destroyed. Profiled builds also get
+        // the profiler trace hooks
+        void InstallEcsHooks();
+
+        // Runs multi-threaded systems of the world on the scheduler workers and publishes TaskSchedulerComponent
+        void AttachWorld(flecs::world& world);
+
+    protected:
+        void QueueJob(Job* job) override;
+        void QueueJobs(Job** jobs, JPH::uint job_count) override;
+        void FreeJob(Job* job) override;
+
+    private:
+        struct alignas(JPH_CACHE_LINE_SIZE) WorkerQueue
+        {
+            std::mutex mutex;
+            std::deque<Job*> jobs;
+        };
+
+        struct EcsTask;
+        struct EcsCondition;
+
+        void WorkerMain(int worker_index, int core_index);
+        void PushJob(Job* job);
+        [[nodiscard]] Job* PopJob(int worker_index);
+        [[nodiscard]] bool RunOneJob(int worker_index);
+        [[nodiscard]] EcsTask* PopEcsTask();
+        void WakeWorkers(bool wake_all);
+
+        static std::uintptr_t EcsTaskNew(void* (*callback)(void*), void* param);
+        static void* EcsTaskJoin(std::uintptr_t task_handle);
+        static std::uintptr_t EcsMutexNew();
+        static void EcsMutexFree(std::uintptr_t mutex_handle);
+        static void EcsMutexLock(std::uintptr_t mutex_handle);
+        static void EcsMutexUnlock(std::uintptr_t mutex_handle);
+        static std::uintptr_t EcsCondNew();
+        static void EcsCondFree(std::uintptr_t cond_handle);
+        static void EcsCondSignal(std::uintptr_t cond_handle);
+        static void EcsCondWait(std::uintptr_t cond_handle, std::uintptr_t mutex_handle);
+
+        using AvailableJobs = JPH::FixedSizeFreeList<Job>;
+
+        AvailableJobs jobs_;
+        std::vector<std::unique_ptr<WorkerQueue>> queues_;
+        std::vector<std::thread> workers_;
+        std::atomic<std::uint32_t> next_queue_{0};
+        std::atomic<int> pending_jobs_{0};
+
+        std::mutex ecs_task_mutex_;
+        std::deque<EcsTask*> ecs_tasks_;
+        std::atomic<int> pending_ecs_tasks_{0};
+
+        // Idle workers, and workers waiting inside a flecs condition, sleep here
+        std::mutex sleep_mutex_;
+        std::condition_variable worker_wake_;
+        // Threads outside the scheduler waiting inside a flecs condition sleep here
+        std::condition_variable external_wake_;
+        std::atomic<bool> quit_{false};
+
+        static TaskScheduler* ecs_instance_;
+    };
+}
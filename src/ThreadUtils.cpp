@@ -0,0 +1,43 @@
+#include "ThreadUtils.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <spdlog/spdlog.h>
+
+
+bool res::PinCurrentThreadToCore(const int core_index)
+{
+    if (core_index < 0)
+    {
+        return false;
+    }
+
+#if defined(_WIN32)
+    constexpr int kMaxMaskCores = static_cast<int>(sizeof(DWORD_PTR) * 8);
+    if (core_index >= kMaxMaskCores)
+    {
+        spdlog::warn("Cannot pin thread to core {}", core_index);
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core_index) != 0;
+#elif defined(__linux__)
+    if (core_index >= CPU_SETSIZE)
+    {
+        spdlog::warn("Cannot pin thread to core {}", core_index);
+        return false;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core_index, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+    return false;
+#endif
+}
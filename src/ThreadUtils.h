@@ -0,0 +1,7 @@
+#pragma once
+
+namespace res
+{
+    // Restricts the calling thread to a single logical core. Returns false where pinning is unsupported
+    bool PinCurrentThreadToCore(int core_index);
+}
@@ -1,15 +1,36 @@
 #pragma once
 
+#include <cstdint>
+
 #include <raylib.h>
 #include <raymath.h>
 
 namespace res
 {
+    // World transform, written by the transform hierarchy for entities with a LocalTransformComponent and
+    // directly by physics and characters otherwise
     struct MatrixComponent
     {
         Matrix matrix{MatrixIdentity()};
     };
 
+    // Transform relative to the ChildOf parent, or to the world for entities without one
+    struct LocalTransformComponent
+    {
+        Vector3 translation{0.0f, 0.0f, 0.0f};
+        Quaternion rotation{QuaternionIdentity()};
+        Vector3 scale{1.0f, 1.0f, 1.0f};
+    };
+
+    // Setting LocalTransformComponent marks the entity dirty, changing it through get_mut needs dirty set by hand.
+    // world_version counts MatrixComponent updates so children only recompute after their parent moved
+    struct TransformStateComponent
+    {
+        bool dirty{true};
+        std::uint32_t world_version{0};
+        std::uint32_t parent_version{0};
+    };
+
     struct DebugCameraMovementComponent {
         int movement_type;
     };
@@ -1,17 +1,91 @@
 #include "TransformSystems.h"
 
+#include <cassert>
+
 #include <flecs.h>
 #include <raylib.h>
+#include <raymath.h>
 
 #include "Phases.h"
 #include "RenderComponents.h"
 #include "TransformComponents.h"
 
+namespace {
+Matrix ComposeMatrix(const res::LocalTransformComponent &local) {
+  const Matrix scale = MatrixScale(local.scale.x, local.scale.y, local.scale.z);
+  const Matrix rotation = QuaternionToMatrix(local.rotation);
+  const Matrix translation = MatrixTranslate(
+      local.translation.x, local.translation.y, local.translation.z);
+  return MatrixMultiply(MatrixMultiply(scale, rotation), translation);
+}
+} // namespace
+
 res::TransformSystems::TransformSystems(flecs::world &world) {
   world.module<TransformSystems>();
 
+  auto on_post_tick_phase = world.lookup(kPostTickPhaseName.data());
   auto on_pre_render_phase = world.lookup(kPreRenderPhaseName.data());
 
+  assert(on_post_tick_phase != 0 && "OnPostTickPhase not found!");
+
+  world.component<LocalTransformComponent>()
+      .add(flecs::With, world.component<TransformStateComponent>())
+      .add(flecs::With, world.component<MatrixComponent>());
+
+  world.observer<const LocalTransformComponent>("Mark Transform Dirty")
+      .event(flecs::OnSet)
+      .each([](flecs::entity entity, const LocalTransformComponent &) {
+        if (auto *state = entity.try_get_mut<TransformStateComponent>()) {
+          state->dirty = true;
+        }
+      });
+
+  // A new parent may happen to have the version the old one had
+  world.observer<TransformStateComponent>("Mark Reparented Transform Dirty")
+      .with(flecs::ChildOf, flecs::Wildcard)
+      .event(flecs::OnAdd)
+      .event(flecs::OnRemove)
+      .each([](TransformStateComponent &state) { state.dirty = true; });
+
+  // Cascade orders tables by depth so every parent is done before its
+  // children, which also keeps this on a single thread. Clean entities under
+  // an unchanged parent cost one compare
+  world
+      .system<const LocalTransformComponent, TransformStateComponent,
+              MatrixComponent, const MatrixComponent *,
+              const TransformStateComponent *>("Update World Transforms")
+      .term_at(3)
+      .parent()
+      .cascade()
+      .term_at(4)
+      .parent()
+      .kind(on_post_tick_phase)
+      .each([](const LocalTransformComponent &local,
+               TransformStateComponent &state,
+               MatrixComponent &matrix_component,
+               const MatrixComponent *parent_matrix,
+               const TransformStateComponent *parent_state) {
+        // Parents without a state can not tell whether they moved
+        const bool parent_moved =
+            parent_matrix != nullptr &&
+            (parent_state == nullptr ||
+             parent_state->world_version != state.parent_version);
+        if (!state.dirty && !parent_moved) {
+          return;
+        }
+
+        Matrix matrix = ComposeMatrix(local);
+        if (parent_matrix != nullptr) {
+          matrix = MatrixMultiply(matrix, parent_matrix->matrix);
+        }
+        if (parent_state != nullptr) {
+          state.parent_version = parent_state->world_version;
+        }
+        matrix_component.matrix = matrix;
+        state.dirty = false;
+        ++state.world_version;
+      });
+
   world
       .system<const DebugCameraMovementComponent, CameraComponent>(
           "Debug Camera Movement")
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <vector>
+
+#include <raylib.h>
+
 namespace res
 {
     struct TextElementComponent
@@ -7,6 +11,29 @@ namespace res
         int font_size{10};
     };
 
+    // Font a text element is drawn with instead of raylib's default font. The font is not owned
+    struct FontComponent
+    {
+        Font font{};
+    };
+
+    struct TextGlyphQuad
+    {
+        // Relative to the position of the text
+        Rectangle destination{};
+        // Normalized coordinates in the font atlas
+        Rectangle source{};
+    };
+
+    // Glyph quads of a text element, shaped once and kept until the text, the element or the font is set again
+    struct TextLayoutComponent
+    {
+        std::vector<TextGlyphQuad> glyphs;
+        unsigned int atlas_id{0};
+        Vector2 size{0.0f, 0.0f};
+        bool dirty{true};
+    };
+
     struct Renderable2dComponent
     {
     };
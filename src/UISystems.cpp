@@ -1,30 +1,197 @@
 #include "UISystems.h"
 
+#include <algorithm>
+
 #include <flecs.h>
 #include <raylib.h>
+#include <rlgl.h>
 
 #include "CommonComponents.h"
+#include "FrameArena.h"
 #include "Phases.h"
 #include "UIComponents.h"
 
 
+namespace
+{
+    // raylib's defaults for DrawText, the line spacing can not be read back from raylib
+    constexpr int kDefaultFontSize = 10;
+    constexpr float kLineSpacing = 2.0f;
+
+    // Same placement as DrawText, with the glyphs relative to the text position
+    void LayoutText(const char* text, const Font& font, int font_size, res::TextLayoutComponent& layout)
+    {
+        layout.glyphs.clear();
+        layout.atlas_id = font.texture.id;
+        layout.size = {0.0f, 0.0f};
+        layout.dirty = false;
+        if (font.texture.id == 0 || font.baseSize <= 0)
+        {
+            return;
+        }
+
+        font_size = std::max(font_size, kDefaultFontSize);
+        const auto spacing = static_cast<float>(font_size / kDefaultFontSize);
+        const float scale = static_cast<float>(font_size) / static_cast<float>(font.baseSize);
+        const auto padding = static_cast<float>(font.glyphPadding);
+        const auto atlas_width = static_cast<float>(font.texture.width);
+        const auto atlas_height = static_cast<float>(font.texture.height);
+
+        float offset_x = 0.0f;
+        float offset_y = 0.0f;
+        for (const char* character = text; *character != '\0';)
+        {
+            int byte_count = 0;
+            const int codepoint = GetCodepointNext(character, &byte_count);
+            character += byte_count;
+            if (codepoint == '\n')
+            {
+                offset_y += static_cast<float>(font_size) + kLineSpacing;
+                offset_x = 0.0f;
+                continue;
+            }
+
+            const int index = GetGlyphIndex(font, codepoint);
+            const Rectangle& rec = font.recs[index];
+            const GlyphInfo& glyph = font.glyphs[index];
+            if (codepoint != ' ' && codepoint != '\t')
+            {
+                const Rectangle source{rec.x - padding, rec.y - padding, rec.width + 2.0f * padding,
+                                       rec.height + 2.0f * padding};
+                layout.glyphs.push_back({
+                    {
+                        offset_x + (static_cast<float>(glyph.offsetX) - padding) * scale,
+                        offset_y + (static_cast<float>(glyph.offsetY) - padding) * scale,
+                        source.width * scale, source.height * scale
+                    },
+                    {
+                        source.x / atlas_width, source.y / atlas_height, source.width / atlas_width,
+                        source.height / atlas_height
+                    }
+                });
+            }
+
+            offset_x += (glyph.advanceX == 0 ? rec.width * scale : static_cast<float>(glyph.advanceX) * scale)
+                + spacing;
+            layout.size.x = std::max(layout.size.x, offset_x);
+        }
+        layout.size.y = offset_y + static_cast<float>(font_size);
+    }
+
+    struct TextDraw
+    {
+        const res::TextLayoutComponent* layout{nullptr};
+        Vector2 position{0.0f, 0.0f};
+        Color color{WHITE};
+    };
+}
+
 res::UISystems::UISystems(flecs::world& world)
 {
     world.module<UISystems>();
 
+    auto on_pre_render_phase = world.lookup(res::kPreRenderPhaseName.data());
     auto on_render_2d_phase = world.lookup(res::kRender2DPhaseName.data());
 
-    world.system<const TextComponent, const Position2dComponent, const Renderable2dComponent, const TextElementComponent
-                 , const ColorComponent>(
+    world.component<TextElementComponent>().add(flecs::With, world.component<TextLayoutComponent>());
+
+    world.observer<const TextComponent, const TextElementComponent>("Invalidate Text Layout")
+         .event(flecs::OnSet)
+         .each([](flecs::entity entity, const TextComponent&, const TextElementComponent&)
+         {
+             if (auto* layout = entity.try_get_mut<TextLayoutComponent>())
+             {
+                 layout->dirty = true;
+             }
+         });
+
+    world.observer<const FontComponent>("Invalidate Text Layout Font")
+         .event(flecs::OnSet)
+         .event(flecs::OnRemove)
+         .each([](flecs::entity entity, const FontComponent&)
+         {
+             if (auto* layout = entity.try_get_mut<TextLayoutComponent>())
+             {
+                 layout->dirty = true;
+             }
+         });
+
+    // Only texts that changed since the last frame are shaped
+    world.system<const TextComponent, const TextElementComponent, const FontComponent*, TextLayoutComponent>(
+             "Layout UI Text")
+         .kind(on_pre_render_phase)
+         .multi_threaded()
+         .each([](const TextComponent& text_component, const TextElementComponent& element_component,
+                  const FontComponent* font_component, TextLayoutComponent& layout)
+         {
+             if (!layout.dirty)
+             {
+                 return;
+             }
+             const Font font = font_component != nullptr ? font_component->font : GetFontDefault();
+             LayoutText(text_component.text.c_str(), font, element_component.font_size, layout);
+         });
+
+    // Draws the cached glyph quads of every text as one quad stream per font atlas. Texts sharing a font keep their
+    // order, texts with different fonts are drawn font by font
+    world.system<const TextLayoutComponent, const Position2dComponent, const Renderable2dComponent,
+                 const ColorComponent>(
              "Render UI Text")
          .kind(on_render_2d_phase)
-         .each([](const TextComponent& text_component, const Position2dComponent& position_component,
-                  const Renderable2dComponent& renderable_component, const TextElementComponent& element_component,
-                  const ColorComponent& color_component)
+         .run([](flecs::iter& it)
          {
-             DrawText(text_component.text.c_str(), static_cast<int>(position_component.x), 
-                      static_cast<int>(position_component.y),
-                      element_component.font_size,
-                      color_component.color);
+             FrameVector<TextDraw> draws;
+             while (it.next())
+             {
+                 const auto layouts = it.field<const TextLayoutComponent>(0);
+                 const auto positions = it.field<const Position2dComponent>(1);
+                 const auto colors = it.field<const ColorComponent>(3);
+                 for (const auto i : it)
+                 {
+                     if (!layouts[i].glyphs.empty())
+                     {
+                         draws.push_back({&layouts[i], {positions[i].x, positions[i].y}, colors[i].color});
+                     }
+                 }
+             }
+
+             std::stable_sort(draws.begin(), draws.end(), [](const TextDraw& lhs, const TextDraw& rhs)
+             {
+                 return lhs.layout->atlas_id < rhs.layout->atlas_id;
+             });
+
+             for (std::size_t begin = 0; begin < draws.size();)
+             {
+                 const unsigned int atlas_id = draws[begin].layout->atlas_id;
+                 // rlgl flushes full batches between quads on its own
+                 rlSetTexture(atlas_id);
+                 rlBegin(RL_QUADS);
+                 rlNormal3f(0.0f, 0.0f, 1.0f);
+                 std::size_t end = begin;
+                 for (; end < draws.size() && draws[end].layout->atlas_id == atlas_id; ++end)
+                 {
+                     const TextDraw& draw = draws[end];
+                     // Positions are whole pixels like DrawText's
+                     const float x = static_cast<float>(static_cast<int>(draw.position.x));
+                     const float y = static_cast<float>(static_cast<int>(draw.position.y));
+                     rlColor4ub(draw.color.r, draw.color.g, draw.color.b, draw.color.a);
+                     for (const TextGlyphQuad& glyph : draw.layout->glyphs)
+                     {
+                         const Rectangle& destination = glyph.destination;
+                         const Rectangle& source = glyph.source;
+                         rlTexCoord2f(source.x, source.y);
+                         rlVertex2f(x + destination.x, y + destination.y);
+                         rlTexCoord2f(source.x, source.y + source.height);
+                         rlVertex2f(x + destination.x, y + destination.y + destination.height);
+                         rlTexCoord2f(source.x + source.width, source.y + source.height);
+                         rlVertex2f(x + destination.x + destination.width, y + destination.y + destination.height);
+                         rlTexCoord2f(source.x + source.width, source.y);
+                         rlVertex2f(x + destination.x + destination.width, y + destination.y);
+                     }
+                 }
+                 rlEnd();
+                 rlSetTexture(0);
+                 begin = end;
+             }
          });
 }
@@ -0,0 +1,721 @@
+#include "WorldSnapshot.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "CommonComponents.h"
+#include "FileUtils.h"
+#include "InputComponents.h"
+#include "PhysicsComponents.h"
+#include "RenderComponents.h"
+#include "TransformComponents.h"
+#include "UIComponents.h"
+
+
+namespace
+{
+    constexpr std::uint32_t kSnapshotFileMagic = 0x504E5352; // "RSNP"
+    constexpr std::uint32_t kSnapshotFileVersion = 1;
+    // Columns start on this boundary so they can be handed to flecs straight out of the mapping
+    constexpr std::size_t kSnapshotAlignment = 16;
+    constexpr std::size_t kComponentNameSize = 48;
+    constexpr std::uint32_t kNoParent = 0xFFFFFFFF;
+    constexpr std::uint32_t kTableHasNames = 1;
+    // Tag only tables take no bytes per entity, so the entity count of a file is bounded by this instead of its size
+    constexpr std::uint64_t kMaxSnapshotEntities = 1u << 24;
+
+    enum class SnapshotStorage : std::uint32_t
+    {
+        // Trivially copyable data, written as one block per table
+        kColumn,
+        // Only the presence is stored, the component is default constructed on load
+        kTag,
+        // Length prefixed text per entity
+        kString
+    };
+
+    struct SnapshotFileHeader
+    {
+        std::uint32_t magic{kSnapshotFileMagic};
+        std::uint32_t version{kSnapshotFileVersion};
+        std::uint32_t component_count{0};
+        std::uint32_t table_count{0};
+        std::uint64_t entity_count{0};
+        std::uint64_t reserved{0};
+    };
+
+    // Components are matched by name on load, so the registration order may change between builds
+    struct SnapshotComponentHeader
+    {
+        char name[kComponentNameSize]{};
+        std::uint32_t size{0};
+        SnapshotStorage storage{SnapshotStorage::kTag};
+        std::uint64_t reserved{0};
+    };
+
+    struct SnapshotTableHeader
+    {
+        std::uint32_t entity_count{0};
+        std::uint32_t component_count{0};
+        std::uint32_t flags{0};
+        // Snapshot index of the parent shared by every entity of the table
+        std::uint32_t parent_index{kNoParent};
+    };
+
+    struct SnapshotComponent
+    {
+        const char* name{nullptr};
+        flecs::id_t id{0};
+        std::uint32_t size{0};
+        SnapshotStorage storage{SnapshotStorage::kTag};
+        // Added per entity once the bulk creation copied the data, for observers that read other components on add
+        bool add_after_data{false};
+        // kString only
+        std::string_view (*get_string)(const void* column, std::int32_t row){nullptr};
+        void (*set_string)(flecs::entity entity, std::string_view value){nullptr};
+    };
+
+    template <typename T>
+    SnapshotComponent ColumnComponent(flecs::world& world, const char* name)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Column components are copied as bytes");
+        return {name, world.component<T>().id(), sizeof(T), SnapshotStorage::kColumn};
+    }
+
+    template <typename T>
+    SnapshotComponent TagComponent(flecs::world& world, const char* name)
+    {
+        return {name, world.component<T>().id(), 0, SnapshotStorage::kTag};
+    }
+
+    // The body observers fire on add and read MatrixComponent, which bulk creation only fills in after OnAdd
+    template <typename T>
+    SnapshotComponent LateTagComponent(flecs::world& world, const char* name)
+    {
+        SnapshotComponent component = TagComponent<T>(world, name);
+        component.add_after_data = true;
+        return component;
+    }
+
+    template <typename T, std::string T::*Member>
+    SnapshotComponent StringComponent(flecs::world& world, const char* name)
+    {
+        return {
+            name, world.component<T>().id(), 0, SnapshotStorage::kString,
+            [](const void* column, const std::int32_t row)
+            {
+                return std::string_view{static_cast<const T*>(column)[row].*Member};
+            },
+            [](flecs::entity entity, const std::string_view value)
+            {
+                T component{};
+                (component.*Member).assign(value);
+                entity.set<T>(std::move(component));
+            }
+        };
+    }
+
+    // Everything else on an entity is derived state: bodies, characters, models, layouts, visibility and LODs are
+    // created again by the observers and systems that own them
+    std::vector<SnapshotComponent> GetSnapshotComponents(flecs::world& world)
+    {
+        using namespace res;
+        return {
+            ColumnComponent<MatrixComponent>(world, "MatrixComponent"),
+            ColumnComponent<LocalTransformComponent>(world, "LocalTransformComponent"),
+            ColumnComponent<ColorComponent>(world, "ColorComponent"),
+            StringComponent<TextComponent, &TextComponent::text>(world, "TextComponent"),
+            TagComponent<PlayerComponent>(world, "PlayerComponent"),
+            ColumnComponent<MovementInputComponent>(world, "MovementInputComponent"),
+            TagComponent<RenderableComponent>(world, "RenderableComponent"),
+            StringComponent<ModelAssetComponent, &ModelAssetComponent::path>(world, "ModelAssetComponent"),
+            TagComponent<SpherePrimitiveComponent>(world, "SpherePrimitiveComponent"),
+            TagComponent<CapsulePrimitiveComponent>(world, "CapsulePrimitiveComponent"),
+            TagComponent<CubePrimitiveComponent>(world, "CubePrimitiveComponent"),
+            ColumnComponent<GridPrimitiveComponent>(world, "GridPrimitiveComponent"),
+            ColumnComponent<BoundsComponent>(world, "BoundsComponent"),
+            ColumnComponent<CameraComponent>(world, "CameraComponent"),
+            ColumnComponent<DebugCameraMovementComponent>(world, "DebugCameraMovementComponent"),
+            ColumnComponent<PhysicsLayerComponent>(world, "PhysicsLayerComponent"),
+            // Saved without the body id, adding it back is what makes the observers create a new body
+            LateTagComponent<PhysicsBodyIdComponent>(world, "PhysicsBodyIdComponent"),
+            TagComponent<RigidbodySphereComponent>(world, "RigidbodySphereComponent"),
+            TagComponent<MeshColliderComponent>(world, "MeshColliderComponent"),
+            ColumnComponent<CharacterControllerComponent>(world, "CharacterControllerComponent"),
+            ColumnComponent<GravityComponent>(world, "GravityComponent"),
+            ColumnComponent<TextElementComponent>(world, "TextElementComponent"),
+            ColumnComponent<Position2dComponent>(world, "Position2dComponent"),
+            TagComponent<Renderable2dComponent>(world, "Renderable2dComponent"),
+            TagComponent<ImageElementComponent>(world, "ImageElementComponent"),
+        };
+    }
+
+    class SnapshotWriter
+    {
+    public:
+        void Write(const void* data, const std::size_t size)
+        {
+            const auto* bytes = static_cast<const std::byte*>(data);
+            buffer_.insert(buffer_.end(), bytes, bytes + size);
+        }
+
+        template <typename T>
+        void WriteValue(const T& value)
+        {
+            Write(&value, sizeof(T));
+        }
+
+        void WriteString(const std::string_view value)
+        {
+            WriteValue(static_cast<std::uint32_t>(value.size()));
+            Write(value.data(), value.size());
+        }
+
+        void Align()
+        {
+            buffer_.resize((buffer_.size() + kSnapshotAlignment - 1) & ~(kSnapshotAlignment - 1));
+        }
+
+        void Reserve(const std::size_t size) { buffer_.reserve(size); }
+        [[nodiscard]] const std::vector<std::byte>& GetBuffer() const { return buffer_; }
+
+    private:
+        std::vector<std::byte> buffer_;
+    };
+
+    // Bounds checked reads out of the mapped file, every read fails once one did
+    class SnapshotReader
+    {
+    public:
+        SnapshotReader(const std::byte* data, const std::size_t size):
+            data_{data}, size_{size}
+        {
+        }
+
+        const std::byte* Read(const std::size_t size)
+        {
+            if (failed_ || size > size_ - offset_)
+            {
+                failed_ = true;
+                return nullptr;
+            }
+            const std::byte* data = data_ + offset_;
+            offset_ += size;
+            return data;
+        }
+
+        template <typename T>
+        bool ReadValue(T& value)
+        {
+            const std::byte* data = Read(sizeof(T));
+            if (data == nullptr)
+            {
+                return false;
+            }
+            std::memcpy(&value, data, sizeof(T));
+            return true;
+        }
+
+        bool ReadString(std::string_view& value)
+        {
+            std::uint32_t length = 0;
+            if (!ReadValue(length))
+            {
+                return false;
+            }
+            const std::byte* data = Read(length);
+            if (data == nullptr)
+            {
+                return false;
+            }
+            value = {reinterpret_cast<const char*>(data), length};
+            return true;
+        }
+
+        void Align()
+        {
+            const std::size_t aligned = (offset_ + kSnapshotAlignment - 1) & ~(kSnapshotAlignment - 1);
+            Read(std::min(aligned, size_) - offset_);
+        }
+
+        [[nodiscard]] const std::byte* GetCursor() const { return data_ + offset_; }
+        [[nodiscard]] bool IsFailed() const { return failed_; }
+
+    private:
+        const std::byte* data_;
+        std::size_t size_;
+        std::size_t offset_{0};
+        bool failed_{false};
+    };
+
+    struct SavedTable
+    {
+        ecs_table_t* table{nullptr};
+        // Indices into the snapshot components, ascending
+        std::vector<std::uint32_t> components;
+        flecs::entity_t parent{0};
+        bool named{false};
+    };
+
+    // Points into the mapped file
+    struct LoadedTable
+    {
+        SnapshotTableHeader header{};
+        std::vector<const SnapshotComponent*> components;
+        std::vector<const std::byte*> columns;
+        const std::byte* names{nullptr};
+        std::size_t first_entity{0};
+    };
+
+    // Skips over a column of length prefixed strings
+    bool SkipStrings(SnapshotReader& reader, const std::uint32_t count)
+    {
+        std::string_view value;
+        for (std::uint32_t row = 0; row < count; ++row)
+        {
+            if (!reader.ReadString(value))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+bool res::SaveWorldSnapshot(flecs::world& world, const std::filesystem::path& path, WorldSnapshotStats* stats)
+{
+    const std::vector<SnapshotComponent> components = GetSnapshotComponents(world);
+    std::unordered_map<flecs::id_t, std::uint32_t> component_indices;
+    for (std::uint32_t i = 0; i < components.size(); ++i)
+    {
+        component_indices.emplace(components[i].id, i);
+    }
+
+    // Every table is visited once, entities are only looked at for names and parents
+    std::vector<SavedTable> tables;
+    std::unordered_set<flecs::entity_t> parents;
+    world.query_builder<>().with(flecs::Any).build().run([&](flecs::iter& it)
+    {
+        while (it.next())
+        {
+            ecs_table_t* table = it.c_ptr()->table;
+            if (table == nullptr || it.count() == 0 || ecs_table_has_id(world, table, ecs_id(EcsComponent)) ||
+                ecs_table_has_id(world, table, EcsModule))
+            {
+                continue;
+            }
+
+            SavedTable saved{table};
+            const ecs_type_t* type = ecs_table_get_type(table);
+            for (std::int32_t i = 0; i < type->count; ++i)
+            {
+                if (const auto found = component_indices.find(type->array[i]); found != component_indices.end())
+                {
+                    saved.components.push_back(found->second);
+                }
+            }
+            if (saved.components.empty())
+            {
+                continue;
+            }
+            std::sort(saved.components.begin(), saved.components.end());
+            saved.parent = ecs_get_target(world, ecs_table_entities(table)[0], EcsChildOf, 0);
+            saved.named = ecs_table_has_id(world, table, ecs_pair(ecs_id(EcsIdentifier), EcsName));
+            if (saved.parent != 0)
+            {
+                parents.insert(saved.parent);
+            }
+            tables.push_back(std::move(saved));
+        }
+    });
+
+    // Roots first, so most children find their parent already created on load
+    std::stable_partition(tables.begin(), tables.end(), [](const SavedTable& table) { return table.parent == 0; });
+
+    std::unordered_map<flecs::entity_t, std::uint32_t> parent_indices;
+    std::uint64_t entity_count = 0;
+    std::size_t column_bytes = 0;
+    for (const SavedTable& saved : tables)
+    {
+        const std::int32_t count = ecs_table_count(saved.table);
+        if (!parents.empty())
+        {
+            const ecs_entity_t* entities = ecs_table_entities(saved.table);
+            for (std::int32_t row = 0; row < count; ++row)
+            {
+                if (parents.contains(entities[row]))
+                {
+                    parent_indices.emplace(entities[row], static_cast<std::uint32_t>(entity_count + row));
+                }
+            }
+        }
+        for (const std::uint32_t index : saved.components)
+        {
+            column_bytes += components[index].size * static_cast<std::size_t>(count) + kSnapshotAlignment;
+        }
+        entity_count += static_cast<std::uint64_t>(count);
+    }
+
+    if (entity_count > kMaxSnapshotEntities)
+    {
+        spdlog::error("World snapshots hold at most {} entities, the world has {}", kMaxSnapshotEntities, entity_count);
+        return false;
+    }
+
+    SnapshotWriter writer;
+    writer.Reserve(sizeof(SnapshotFileHeader) + components.size() * sizeof(SnapshotComponentHeader) +
+        tables.size() * (sizeof(SnapshotTableHeader) + kSnapshotAlignment * 2) + column_bytes);
+
+    SnapshotFileHeader header{};
+    header.component_count = static_cast<std::uint32_t>(components.size());
+    header.table_count = static_cast<std::uint32_t>(tables.size());
+    header.entity_count = entity_count;
+    writer.WriteValue(header);
+    for (const SnapshotComponent& component : components)
+    {
+        SnapshotComponentHeader component_header{};
+        std::strncpy(component_header.name, component.name, kComponentNameSize - 1);
+        component_header.size = component.size;
+        component_header.storage = component.storage;
+        writer.WriteValue(component_header);
+    }
+
+    std::uint32_t orphaned_tables = 0;
+    for (const SavedTable& saved : tables)
+    {
+        const std::int32_t count = ecs_table_count(saved.table);
+        SnapshotTableHeader table_header{};
+        table_header.entity_count = static_cast<std::uint32_t>(count);
+        table_header.component_count = static_cast<std::uint32_t>(saved.components.size());
+        table_header.flags = saved.named ? kTableHasNames : 0;
+        if (saved.parent != 0)
+        {
+            // Parents without a snapshot component are not saved, their children end up at the root
+            const auto found = parent_indices.find(saved.parent);
+            table_header.parent_index = found != parent_indices.end() ? found->second : kNoParent;
+            orphaned_tables += found == parent_indices.end() ? 1 : 0;
+        }
+        writer.WriteValue(table_header);
+        for (const std::uint32_t index : saved.components)
+        {
+            writer.WriteValue(index);
+        }
+        writer.Align();
+
+        for (const std::uint32_t index : saved.components)
+        {
+            const SnapshotComponent& component = components[index];
+            if (component.storage == SnapshotStorage::kTag)
+            {
+                continue;
+            }
+            const void* column = ecs_table_get_id(world, saved.table, component.id, 0);
+            if (component.storage == SnapshotStorage::kColumn)
+            {
+                writer.Write(column, component.size * static_cast<std::size_t>(count));
+            }
+            else
+            {
+                for (std::int32_t row = 0; row < count; ++row)
+                {
+                    writer.WriteString(component.get_string(column, row));
+                }
+            }
+            writer.Align();
+        }
+
+        if (saved.named)
+        {
+            const ecs_entity_t* entities = ecs_table_entities(saved.table);
+            for (std::int32_t row = 0; row < count; ++row)
+            {
+                const char* name = ecs_get_name(world, entities[row]);
+                writer.WriteString(name != nullptr ? name : "");
+            }
+            writer.Align();
+        }
+    }
+    if (orphaned_tables > 0)
+    {
+        spdlog::warn("{} snapshot tables have a parent that is not saved, they are stored at the root",
+                     orphaned_tables);
+    }
+
+    std::error_code error;
+    if (path.has_parent_path())
+    {
+        std::filesystem::create_directories(path.parent_path(), error);
+    }
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+        if (!file)
+        {
+            spdlog::error("Failed to open {} for writing", temp_path.string());
+            return false;
+        }
+        const std::vector<std::byte>& buffer = writer.GetBuffer();
+        file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        if (!file)
+        {
+            spdlog::error("Failed to write world snapshot {}", temp_path.string());
+            return false;
+        }
+    }
+
+    // Rename last so a crash mid-write never replaces a snapshot with a truncated one
+    std::filesystem::rename(temp_path, path, error);
+    if (error)
+    {
+        spdlog::error("Failed to store world snapshot {}: {}", path.string(), error.message());
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+
+    if (stats != nullptr)
+    {
+        *stats = {entity_count, header.table_count, writer.GetBuffer().size()};
+    }
+    return true;
+}
+
+bool res::LoadWorldSnapshot(flecs::world& world, const std::filesystem::path& path, WorldSnapshotStats* stats)
+{
+    const MappedFile file{path};
+    if (!file.IsOpen())
+    {
+        spdlog::error("Failed to open world snapshot {}", path.string());
+        return false;
+    }
+
+    SnapshotReader reader{file.GetData(), file.GetSize()};
+    SnapshotFileHeader header{};
+    if (!reader.ReadValue(header) || header.magic != kSnapshotFileMagic || header.version != kSnapshotFileVersion)
+    {
+        spdlog::error("{} is not a world snapshot of this version", path.string());
+        return false;
+    }
+    if (header.entity_count > kMaxSnapshotEntities ||
+        header.component_count > file.GetSize() / sizeof(SnapshotComponentHeader) ||
+        header.table_count > file.GetSize() / sizeof(SnapshotTableHeader))
+    {
+        spdlog::error("World snapshot {} is corrupted", path.string());
+        return false;
+    }
+
+    const std::vector<SnapshotComponent> components = GetSnapshotComponents(world);
+    std::vector<const SnapshotComponent*> file_components(header.component_count, nullptr);
+    for (std::uint32_t i = 0; i < header.component_count; ++i)
+    {
+        SnapshotComponentHeader component_header{};
+        if (!reader.ReadValue(component_header))
+        {
+            spdlog::error("World snapshot {} is truncated", path.string());
+            return false;
+        }
+        const char* name_end = std::find(component_header.name, component_header.name + kComponentNameSize, '\0');
+        const std::string_view name{component_header.name, static_cast<std::size_t>(name_end - component_header.name)};
+        const auto found = std::find_if(components.begin(), components.end(), [name](const SnapshotComponent& c)
+        {
+            return name == c.name;
+        });
+        if (found == components.end() || found->size != component_header.size ||
+            found->storage != component_header.storage)
+        {
+            spdlog::error("Component {} of world snapshot {} does not match this build", name, path.string());
+            return false;
+        }
+        file_components[i] = &*found;
+    }
+
+    // Everything is validated before the first entity is created, a broken file leaves the world untouched
+    std::vector<LoadedTable> tables(header.table_count);
+    std::uint64_t entity_count = 0;
+    for (LoadedTable& table : tables)
+    {
+        if (!reader.ReadValue(table.header) || table.header.component_count + 1 >= FLECS_ID_DESC_MAX)
+        {
+            spdlog::error("World snapshot {} is corrupted", path.string());
+            return false;
+        }
+        table.first_entity = entity_count;
+        entity_count += table.header.entity_count;
+        if (table.header.entity_count == 0 || entity_count > header.entity_count)
+        {
+            spdlog::error("World snapshot {} is corrupted", path.string());
+            return false;
+        }
+        for (std::uint32_t i = 0; i < table.header.component_count; ++i)
+        {
+            std::uint32_t index = 0;
+            if (!reader.ReadValue(index) || index >= file_components.size())
+            {
+                spdlog::error("World snapshot {} is corrupted", path.string());
+                return false;
+            }
+            table.components.push_back(file_components[index]);
+        }
+        reader.Align();
+
+        for (const SnapshotComponent* component : table.components)
+        {
+            table.columns.push_back(reader.GetCursor());
+            if (component->storage == SnapshotStorage::kColumn)
+            {
+                reader.Read(component->size * static_cast<std::size_t>(table.header.entity_count));
+            }
+            else if (component->storage == SnapshotStorage::kString)
+            {
+                SkipStrings(reader, table.header.entity_count);
+            }
+            if (component->storage != SnapshotStorage::kTag)
+            {
+                reader.Align();
+            }
+        }
+        if ((table.header.flags & kTableHasNames) != 0)
+        {
+            table.names = reader.GetCursor();
+            SkipStrings(reader, table.header.entity_count);
+            reader.Align();
+        }
+        if (reader.IsFailed())
+        {
+            spdlog::error("World snapshot {} is truncated", path.string());
+            return false;
+        }
+    }
+    if (entity_count != header.entity_count)
+    {
+        spdlog::error("World snapshot {} is corrupted", path.string());
+        return false;
+    }
+
+    // One bulk creation per table, flecs copies the columns out of the mapping and runs the OnAdd and OnSet
+    // observers for the whole batch
+    std::vector<flecs::entity_t> entities;
+    entities.reserve(entity_count);
+    std::vector<const LoadedTable*> reparented;
+    for (const LoadedTable& table : tables)
+    {
+        ecs_bulk_desc_t desc{};
+        std::array<void*, FLECS_ID_DESC_MAX> data{};
+        std::size_t id_count = 0;
+        for (std::size_t i = 0; i < table.components.size(); ++i)
+        {
+            if (table.components[i]->add_after_data)
+            {
+                continue;
+            }
+            desc.ids[id_count] = table.components[i]->id;
+            if (table.components[i]->storage == SnapshotStorage::kColumn)
+            {
+                data[id_count] = const_cast<std::byte*>(table.columns[i]);
+            }
+            ++id_count;
+        }
+        if (table.header.parent_index != kNoParent)
+        {
+            if (table.header.parent_index < entities.size())
+            {
+                desc.ids[id_count++] = ecs_pair(EcsChildOf, entities[table.header.parent_index]);
+            }
+            else
+            {
+                reparented.push_back(&table);
+            }
+        }
+        desc.count = static_cast<std::int32_t>(table.header.entity_count);
+        desc.data = data.data();
+
+        const ecs_entity_t* created = ecs_bulk_init(world, &desc);
+        entities.insert(entities.end(), created, created + table.header.entity_count);
+
+        for (const SnapshotComponent* component : table.components)
+        {
+            if (!component->add_after_data)
+            {
+                continue;
+            }
+            for (std::uint32_t row = 0; row < table.header.entity_count; ++row)
+            {
+                ecs_add_id(world, entities[table.first_entity + row], component->id);
+            }
+        }
+    }
+
+    for (const LoadedTable* table : reparented)
+    {
+        if (table->header.parent_index >= entities.size())
+        {
+            spdlog::warn("World snapshot {} references a missing parent", path.string());
+            continue;
+        }
+        const flecs::entity_t parent = entities[table->header.parent_index];
+        for (std::uint32_t row = 0; row < table->header.entity_count; ++row)
+        {
+            ecs_add_pair(world, entities[table->first_entity + row], EcsChildOf, parent);
+        }
+    }
+
+    // Strings and names are set per entity once the hierarchy is in place, names are unique per parent
+    const std::byte* file_end = file.GetData() + file.GetSize();
+    std::string name;
+    for (const LoadedTable& table : tables)
+    {
+        for (std::size_t i = 0; i < table.components.size(); ++i)
+        {
+            const SnapshotComponent* component = table.components[i];
+            if (component->storage != SnapshotStorage::kString)
+            {
+                continue;
+            }
+            SnapshotReader strings{table.columns[i], static_cast<std::size_t>(file_end - table.columns[i])};
+            std::string_view value;
+            for (std::uint32_t row = 0; row < table.header.entity_count && strings.ReadString(value); ++row)
+            {
+                component->set_string(flecs::entity{world, entities[table.first_entity + row]}, value);
+            }
+        }
+
+        if (table.names == nullptr)
+        {
+            continue;
+        }
+        SnapshotReader names{table.names, static_cast<std::size_t>(file_end - table.names)};
+        std::string_view value;
+        for (std::uint32_t row = 0; row < table.header.entity_count && names.ReadString(value); ++row)
+        {
+            const flecs::entity_t entity = entities[table.first_entity + row];
+            name.assign(value);
+            if (name.empty())
+            {
+                continue;
+            }
+            if (ecs_lookup_child(world, ecs_get_target(world, entity, EcsChildOf, 0), name.c_str()) != 0)
+            {
+                spdlog::warn("Entity name {} from world snapshot {} is already taken", name, path.string());
+                continue;
+            }
+            ecs_set_name(world, entity, name.c_str());
+        }
+    }
+
+    if (stats != nullptr)
+    {
+        *stats = {entity_count, header.table_count, file.GetSize()};
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+#include <flecs.h>
+
+namespace res
+{
+    struct WorldSnapshotStats
+    {
+        std::uint64_t entity_count{0};
+        std::uint32_t table_count{0};
+        std::size_t byte_count{0};
+    };
+
+    // Writes every entity holding one of the engine's snapshot components to path. Components are written column by
+    // column straight out of the archetype tables, runtime state such as physics bodies, GPU resources and caches is
+    // left out and rebuilt on load. Call outside of systems
+    bool SaveWorldSnapshot(flecs::world& world, const std::filesystem::path& path, WorldSnapshotStats* stats = nullptr);
+
+    // Creates the entities of a snapshot next to the ones already in the world, one bulk creation per saved table with
+    // the component data read from the mapped file. Physics bodies, characters and models come back through the
+    // observers that create them for new entities. Call outside of systems
+    bool LoadWorldSnapshot(flecs::world& world, const std::filesystem::path& path, WorldSnapshotStats* stats = nullptr);
+}